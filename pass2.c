@@ -2,6 +2,25 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <limits.h>
+#include <time.h>
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#undef DELETE /* winnt.h access right, clashes with the object macro below */
+#else
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#endif
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
 
 #pragma GCC diagnostic ignored "-Wunknown-pragmas"
 #pragma region GCC
@@ -23,27 +42,316 @@
 *	VALID = simple NULL check.
 *	NEW = create an "instance" of an "object" and invoke constructor (and set destructor reference)
 *	DELETE = calls "object" destructor for easy clean up. Destructors should invoke ___defaultConstructor to free the memory for the "object instance."
+*	ALLOCATE / REALLOCATE / RELEASE = calloc / realloc / free for object instances and the buffers they own, drawn from the active arena if there is one.
+*	ARENA_BEGIN / ARENA_END = start a region that every ALLOCATE draws from, and later give all of it back at once without running destructors.
+*	Every OBJECT also gets a typeStats record that NEW and DELETE keep up to date, see memory stats below.
+*	THREAD_LOCAL / ___atomicXYZ = the bits of C11 threads.h / stdatomic.h we need, spelled so MSVC's C compiler accepts them too.
+*	Shared counters (objectCount, typeStats, heap stats) are atomic, the active arena and diagnostics sink are per thread.
+*	An arena and everything allocated from it belong to one thread at a time.
 */
 typedef enum { false, true } bool;
 typedef void* (*constructor)();
 typedef void (*destructor)(void*);
-typedef struct object { destructor destructor; } object;
+typedef struct typeStats typeStats;
+typedef struct object { destructor destructor; typeStats* type; } object;
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+
+static unsigned long ___atomicAdd(unsigned long* target, long amount) /* returns the new value */
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	return (unsigned long)(_InterlockedExchangeAdd((volatile long*)target, amount) + amount); //unsigned long is 32 bits on windows.
+#else
+	return __atomic_add_fetch(target, (unsigned long)amount, __ATOMIC_RELAXED);
+#endif
+}
+static unsigned long ___atomicLoad(unsigned long* target)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	return *(volatile unsigned long*)target;
+#else
+	return __atomic_load_n(target, __ATOMIC_ACQUIRE);
+#endif
+}
+static bool ___atomicSwap(unsigned long* target, unsigned long expected, unsigned long desired) /* compare-and-swap, true if target held expected */
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	return _InterlockedCompareExchange((volatile long*)target, (long)desired, (long)expected) == (long)expected;
+#else
+	return __atomic_compare_exchange_n(target, &expected, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+}
+static void ___atomicMax(unsigned long* target, unsigned long value)
+{
+	unsigned long seen = ___atomicLoad(target);
+	while (value > seen && !___atomicSwap(target, seen, value))
+		seen = ___atomicLoad(target);
+}
+
+unsigned long objectCount = 0; //unsigned long = space for plenty of objects. Atomic, objects come and go on every thread.
+
+#pragma region memory stats
+/*
+*	Per-type and per-allocation counters. These are a handful of increments per NEW / ALLOCATE, so they stay on in every build;
+*	running with --mem-stats (or building with DEBUG_MEM) prints the table at exit together with the peak RSS of the process.
+*	Type bytes only cover the instances themselves, buffers they own show up in the allocation line.
+*	A type is registered (given a row) the first time it is constructed; a thread that loses that race leaves its slot empty.
+*/
+#define MAX_OBJECT_TYPES 32 //types past this still work, they are just left out of the table.
+
+struct typeStats { const char* name; unsigned long size; unsigned long index; unsigned long live; unsigned long total; unsigned long peak; };
+typedef struct heapStats { unsigned long live; unsigned long peak; unsigned long total; unsigned long calls; } heapStats;
+
+typeStats* ___types[MAX_OBJECT_TYPES + 1]; /* slot 0 = unregistered */
+unsigned long ___typeCount = 0;
+heapStats ___heap = { 0, 0, 0, 0 };
+bool ___memStats = false;
+
+static void ___countAllocation(unsigned long size)
+{
+	___atomicAdd(&___heap.calls, 1);
+	___atomicAdd(&___heap.total, (long)size);
+	___atomicMax(&___heap.peak, ___atomicAdd(&___heap.live, (long)size));
+}
+static void ___registerType(typeStats* type)
+{
+	unsigned long index = ___atomicAdd(&___typeCount, 1);
+	if (index > MAX_OBJECT_TYPES)
+		return;
+	___types[index] = type; /* published by the swap below */
+	if (!___atomicSwap(&type->index, 0, index))
+		___types[index] = NULL;
+}
+static long ___peakRSS() /* KiB, -1 if the platform will not say */
+{
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return -1;
+	return (long)(counters.PeakWorkingSetSize / 1024);
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return -1;
+#if defined(__APPLE__)
+	return usage.ru_maxrss / 1024; /* bytes on macOS */
+#else
+	return usage.ru_maxrss;
+#endif
+#endif
+}
+void ___printMemStats()
+{
+	fprintf(stderr, "[memory] %-18s %10s %10s %10s %12s\n", "type", "live", "total", "peak", "peak bytes");
+	for (unsigned long i = 1; i <= ___typeCount && i <= MAX_OBJECT_TYPES; ++i)
+	{
+		const typeStats* type = ___types[i];
+		if (!type)
+			continue;
+		fprintf(stderr, "[memory] %-18s %10lu %10lu %10lu %12lu\n", type->name, type->live, type->total, type->peak, type->peak * type->size);
+	}
+	fprintf(stderr, "[memory] allocations: %lu calls, %lu bytes total, %lu bytes peak, %lu bytes live\n", ___heap.calls, ___heap.total, ___heap.peak, ___heap.live);
+	long rss = ___peakRSS();
+	if (rss >= 0)
+		fprintf(stderr, "[memory] peak RSS: %ld KiB\n", rss);
+}
+#pragma endregion
+
+#pragma region arena
+/*
+*	Region allocator. While an arena is active, ALLOCATE carves zeroed memory out of large blocks instead of calling calloc,
+*	RELEASE only hands space back if it was the last allocation, and ARENA_END frees the blocks with no per-object teardown.
+*	Each allocation carries a small header naming its owner, so memory from before the arena (or without one) is still freed normally.
+*	Objects that are still alive when their arena ends are taken off objectCount, so DEBUG_MEM keeps reporting real leaks only.
+*/
+#ifndef USE_ARENA
+#define USE_ARENA 1 //build with -DUSE_ARENA=0 to run every destructor at exit (leak hunting).
+#endif
+#define ARENA_BLOCK_SIZE (1UL << 20)
+#define ARENA_ALIGN(SIZE) (((SIZE) + 15) & ~15UL)
+
+typedef struct arenaBlock { struct arenaBlock* next; unsigned long used; unsigned long size; unsigned long padding; } arenaBlock; //32 bytes, payload stays 16 byte aligned.
+typedef struct arena { arenaBlock* head; unsigned long objects; unsigned long bytes; unsigned long blocks; unsigned long live; unsigned long types[MAX_OBJECT_TYPES + 1]; } arena; //live = requested bytes not yet released, types = live objects per typeStats index.
+typedef struct allocation { arena* owner; unsigned long size; } allocation; //header in front of every ALLOCATE, owner NULL = plain heap.
 
-unsigned long objectCount = 0; //unsigned long = space for plenty of objects.
+THREAD_LOCAL arena* ___activeArena = NULL;
+
+arena* ___arenaBegin()
+{
+	arena* instance = calloc(1, sizeof(arena));
+	___activeArena = instance;
+	return instance;
+}
+void ___arenaEnd(arena* who)
+{
+	if (who == NULL)
+		return;
+	if (___activeArena == who)
+		___activeArena = NULL;
+	___atomicAdd(&objectCount, -(long)who->objects); /* released together with the arena, not leaked */
+	for (unsigned int i = 1; i <= MAX_OBJECT_TYPES; ++i)
+		if (who->types[i] != 0)
+			___atomicAdd(&___types[i]->live, -(long)who->types[i]);
+	___atomicAdd(&___heap.live, -(long)who->live);
+#if DEBUG_MEM
+	printf("[arena] released %lu objects, %lu bytes in %lu blocks\n", who->objects, who->bytes, who->blocks);
+#endif
+	while (who->head != NULL)
+	{
+		arenaBlock* next = who->head->next;
+		free(who->head);
+		who->head = next;
+	}
+	free(who);
+}
+static void* ___arenaAllocate(arena* owner, unsigned long size)
+{
+	unsigned long total = sizeof(allocation) + ARENA_ALIGN(size);
+	arenaBlock* block = owner->head;
+	if (block == NULL || block->used + total > block->size)
+	{
+		unsigned long blockSize = total > ARENA_BLOCK_SIZE ? total : ARENA_BLOCK_SIZE;
+		block = calloc(1, sizeof(arenaBlock) + blockSize);
+		if (block == NULL)
+			return NULL;
+		block->size = blockSize;
+		block->next = owner->head;
+		owner->head = block;
+		++owner->blocks;
+	}
+	allocation* header = (allocation*)((char*)(block + 1) + block->used);
+	block->used += total;
+	owner->bytes += total;
+	owner->live += size;
+	header->owner = owner;
+	header->size = size;
+	___countAllocation(size);
+	return header + 1;
+}
+void* ___allocateFrom(arena* owner, unsigned long size) /* owner NULL = plain heap */
+{
+	if (owner != NULL)
+		return ___arenaAllocate(owner, size);
+	allocation* header = calloc(1, sizeof(allocation) + size);
+	if (header == NULL)
+		return NULL;
+	header->owner = NULL;
+	header->size = size;
+	___countAllocation(size);
+	return header + 1;
+}
+void* ___allocate(unsigned long size)
+{
+	return ___allocateFrom(___activeArena, size);
+}
+void ___release(void* who)
+{
+	if (who == NULL)
+		return;
+	allocation* header = (allocation*)who - 1;
+	___atomicAdd(&___heap.live, -(long)header->size);
+	if (header->owner == NULL)
+	{
+		free(header);
+		return;
+	}
+	header->owner->live -= header->size;
+	arenaBlock* block = header->owner->head;
+	unsigned long total = sizeof(allocation) + ARENA_ALIGN(header->size);
+	if ((char*)header + total == (char*)(block + 1) + block->used) /* most recent allocation, hand it back (zeroed, ALLOCATE promises calloc) */
+	{
+		block->used -= total;
+		header->owner->bytes -= total;
+		memset(header, 0, total);
+	}
+}
+void* ___reallocate(void* who, unsigned long size)
+{
+	if (who == NULL)
+		return ___allocate(size);
+	allocation* header = (allocation*)who - 1;
+	if (header->owner == NULL)
+	{
+		unsigned long previous = header->size;
+		header = realloc(header, sizeof(allocation) + size);
+		if (header == NULL)
+			return NULL;
+		header->size = size;
+		___atomicAdd(&___heap.live, -(long)previous);
+		___countAllocation(size);
+		___atomicAdd(&___heap.calls, -1);
+		return header + 1;
+	}
+	arenaBlock* block = header->owner->head;
+	unsigned long total = sizeof(allocation) + ARENA_ALIGN(header->size);
+	unsigned long nextTotal = sizeof(allocation) + ARENA_ALIGN(size);
+	if ((char*)header + total == (char*)(block + 1) + block->used && block->used - total + nextTotal <= block->size)
+	{
+		/* most recent allocation with room behind it, grow in place */
+		block->used = block->used - total + nextTotal;
+		header->owner->bytes = header->owner->bytes - total + nextTotal;
+		header->owner->live = header->owner->live - header->size + size;
+		___atomicAdd(&___heap.live, -(long)header->size);
+		___countAllocation(size);
+		___atomicAdd(&___heap.calls, -1);
+		header->size = size;
+		return who;
+	}
+	void* next = ___arenaAllocate(header->owner, size);
+	if (next == NULL)
+		return NULL;
+	memcpy(next, who, header->size < size ? header->size : size);
+	___release(who);
+	return next;
+}
+static arena* ___ownerOf(const void* who)
+{
+	return ((const allocation*)who - 1)->owner;
+}
+#define ALLOCATE(COUNT, SIZE) ___allocate((unsigned long)(COUNT) * (SIZE))
+#define ALLOCATE_BESIDE(WHO, COUNT, SIZE) ___allocateFrom(___ownerOf(WHO), (unsigned long)(COUNT) * (SIZE)) //same arena (or heap) as WHO, for buffers an object replaces after construction.
+#define REALLOCATE(WHO, SIZE) ___reallocate(WHO, SIZE)
+#define RELEASE(WHO) ___release(WHO)
+#define ARENA_BEGIN() ___arenaBegin()
+#define ARENA_END(WHO) ___arenaEnd(WHO)
+#pragma endregion
 
-void* ___constructObject(constructor a, destructor b)
+void* ___constructObject(constructor a, destructor b, typeStats* type)
 {
 	void* instance = a();
 	((struct object*)instance)->destructor = b;
-	++objectCount;
+	((struct object*)instance)->type = type;
+	___atomicAdd(&objectCount, 1);
+	if (___atomicLoad(&type->index) == 0 && ___atomicLoad(&___typeCount) < MAX_OBJECT_TYPES)
+		___registerType(type);
+	___atomicAdd(&type->total, 1);
+	___atomicMax(&type->peak, ___atomicAdd(&type->live, 1));
+	if (___ownerOf(instance) != NULL)
+	{
+		++___ownerOf(instance)->objects;
+		++___ownerOf(instance)->types[___atomicLoad(&type->index)];
+	}
 	return instance;
 }
 void* ___invokeDestructor(object** who)
 {
 	if (who != NULL && *who != NULL && (*who)->destructor != NULL)
 	{
+		arena* owner = ___ownerOf(*who);
+		typeStats* type = (*who)->type;
 		(*who)->destructor(*who);
-		--objectCount;
+		___atomicAdd(&objectCount, -1);
+		___atomicAdd(&type->live, -1);
+		if (owner != NULL)
+		{
+			--owner->objects;
+			--owner->types[type->index];
+		}
 		*who = NULL;
 	}
 	return NULL;
@@ -57,18 +365,39 @@ void ___memory_managed()
 	if (objectCount != 0)
 		printf("Program exited without properly cleaning up some objects. This indiciates a potential memory leak! (%li != 0)\n", objectCount);
 }
-object* ___defaultConstructor() { printf("default constructor\n"); return calloc(1, sizeof(object*)); }
-void ___defaultDestructor(void* who) { free(who); }
+object* ___defaultConstructor() { printf("default constructor\n"); return ALLOCATE(1, sizeof(object)); }
+void ___defaultDestructor(void* who) { RELEASE(who); }
 int ___main(int argc, char* argv[]);
+void ___seedHash(); /* picks the per-process hash seed, see text_hash */
+#if BENCHMARK
+int ___benchmark(int argc, char* argv[]);
+#endif
 #define VALID(who) ___is_valid(who)
 #define ASSERT_MEM ___memory_managed()
 #define MAIN ___main
 int main(int argc, char* argv[]) /* All code is in MAIN. This entry point simply maps to that while also adding some debugging code. */
 {
+	___seedHash();
+	for (int i = 1; i < argc; ++i) /* strip runtime switches before MAIN sees the arguments */
+	{
+		if (strcmp(argv[i], "--mem-stats") == 0)
+		{
+			___memStats = true;
+			memmove(argv + i, argv + i + 1, (argc - i) * sizeof(char*));
+			--argc;
+			--i;
+		}
+	}
+#if BENCHMARK
+	return ___benchmark(argc, argv);
+#endif
 	int ret = MAIN(argc, argv);
 #if DEBUG_MEM
 	ASSERT_MEM;
+	___memStats = true;
 #endif
+	if (___memStats)
+		___printMemStats();
 	return ret;
 }
 
@@ -77,13 +406,15 @@ int main(int argc, char* argv[]) /* All code is in MAIN. This entry point simply
 #define USE_DEFAULT_CONSTRUCTOR(TYPE) CONSTRUCTOR(TYPE) {return (TYPE*)___defaultConstructor(); }
 #define USE_DEFAULT_DESTRUCTOR(TYPE)  DESTRUCTOR(TYPE){___defaultDestructor(instance);};
 #define USE_DEFAULT_CTORS(TYPE) USE_DEFAULT_CONSTRUCTOR(TYPE); USE_DEFAULT_DESTRUCTOR(TYPE);
-#define NEW(TYPE) ___constructObject((constructor) ___construct##TYPE, (destructor) ___destroy##TYPE)
+#define NEW(TYPE) ___constructObject((constructor) ___construct##TYPE, (destructor) ___destroy##TYPE, &___type##TYPE)
 #define DELETE(WHO) ___invokeDestructor((object**)&WHO)
 #define OBJECT(TYPE, REST) \
 typedef struct TYPE { \
 	destructor destructor; \
+	typeStats* type; \
 	REST; \
 } TYPE; \
+typeStats ___type##TYPE = { #TYPE, sizeof(TYPE), 0, 0, 0, 0 }; \
 CONSTRUCTOR(TYPE); \
 DESTRUCTOR(TYPE); \
 
@@ -97,16 +428,29 @@ DESTRUCTOR(TYPE); \
 OBJECT(vector, object** data; unsigned int num; unsigned int limit;)
 FUNCTION(vector, push_back, void, object*);
 FUNCTION_NOARG(vector, grow, void);
+FUNCTION(vector, reserve, void, unsigned int); //room for at least count entries without growing.
 
-OBJECT(string, unsigned int length; char* c_str; unsigned int limit; ) //string object.
+/*
+* string object. Short values (under STRING_INLINE characters) live in the inline buffer, c_str only moves to the heap once they outgrow it.
+* c_str always points at the current text, so readers never need to care which storage is in use.
+*/
+#define STRING_INLINE 24 //keeps sizeof(string) at 56 bytes.
+OBJECT(string, char* c_str; unsigned int length; unsigned int limit; char inline_str[STRING_INLINE];)
 FUNCTION(string, append, void, const char*); //append text to string.
+FUNCTION(string, append_slice, void, const char*, unsigned int); //append the first length characters of text.
+FUNCTION(string, reserve, void, unsigned int); //makes room for at least the given length (plus terminator).
+FUNCTION_NOARG(string, clear, void); //empties the string, keeping its storage.
 FUNCTION(string, append_int, void, const int);
 FUNCTION(string, setEqual, string*, string*); //make string A into B and destroy the orignal A.
 FUNCTION(string, areSame, bool, string*); //checks if A == B by value.
 FUNCTION(string, format, void, const char*, ...);
+FUNCTION(string, vformat, void, const char*, va_list); //printf straight into the spare capacity, growing at most once.
+FUNCTION(string, append_hex, void, unsigned int, unsigned int); //same text as "%0<width>X" without going through printf.
 STATIC_FUNCTION(string, make_and_format, string*, const char*, ...);
 FUNCTION_NOARG(string, hash, unsigned int); //gets the hash of a string.
-FUNCTION(string, split, void, vector*, const char*);
+unsigned int cstr_hash(const char*); //same hash as string_hash for a raw c-string, used for lookups without building a string.
+unsigned int text_hash(const char*, unsigned int); //same hash over the first length characters.
+unsigned long long key_hash(unsigned long long); //seeded mix of an integer key (packed symbols).
 
 OBJECT(pair, unsigned int first; unsigned int second;) //key-value pair object for hash table.
 FUNCTION(pair, make, void, unsigned int, unsigned int); //create key-value pair from string and int.
@@ -114,22 +458,127 @@ FUNCTION(pair, make, void, unsigned int, unsigned int); //create key-value pair
 OBJECT(bucket, string* first; pair* second;)
 FUNCTION(bucket, make, void, const char*, pair*);
 /*
-* Hash table data-structure. TODO non const char* versions of has/remove
+* Probe-length statistics for the open-addressed tables. Built with TABLE_STATS the symbol table's are printed at exit,
+* a hashTable's when it is deleted.
+*/
+typedef struct probeStats { unsigned long lookups; unsigned long probes; unsigned int longest; } probeStats;
+void probeStats_record(probeStats* stats, unsigned int probes);
+void probeStats_print(const char* name, const probeStats* stats, unsigned int num, unsigned int limit, unsigned int tombstones);
+
+/*
+* Hash table data-structure. Linear probing, lookups take a const char* and return borrowed pointers (do NOT DELETE them).
+* Removed entries leave a tombstone so probe chains running through them stay intact.
+* The table grows once (entries + tombstones) exceeds loadFactor percent of the buckets.
+* Symbols live in symbolTable, this stays the general string-keyed map for everything that isn't a 6-character symbol.
 */
-OBJECT(hashTable, bucket** buckets; unsigned int num; unsigned int limit;); //hash table object.
+#ifndef HASHTABLE_LOAD_FACTOR
+#define HASHTABLE_LOAD_FACTOR 70
+#endif
+OBJECT(hashTable, bucket** buckets; unsigned int num; unsigned int limit; unsigned int tombstones; unsigned int loadFactor; probeStats stats;); //hash table object.
 FUNCTION(hashTable, insert, void, const char* k, pair* v); //insert item into hash table.
 FUNCTION(hashTable, remove, void, const char*); //remove item from hash table.
 FUNCTION(hashTable, has, bool, const char*); //checks if hash table includes item.
+FUNCTION(hashTable, rehash, void, unsigned int); //moves every live entry into a table with the given number of buckets, dropping tombstones.
 FUNCTION_NOARG(hashTable, grow, void); //if the number of buckets is insufficient to hold items, increase the number of buckets.
-FUNCTION(hashTable, get, bucket*, const char*);
+FUNCTION(hashTable, get, bucket*, const char*); //borrowed bucket, NULL if missing.
+FUNCTION(hashTable, setLoadFactor, void, unsigned int); //percent (10 - 95) of buckets that may be used before growing.
+FUNCTION(hashTable, reserve, void, unsigned int); //enough buckets for count entries without growing.
+
+typedef struct slice { const char* text; unsigned int length; } slice; //borrowed view into someone else's text, not NUL terminated.
+#define SLICE_ARGS(S) (int)(S).length, (S).text //arguments for a "%.*s" conversion.
+
+/*
+* Interning pool. Each distinct identifier is stored once (NUL terminated) in one contiguous arena and named by a small integer ID,
+* so equal text <=> equal ID. ID 0 is always the empty string. Text pointers are borrowed and only valid until the next intern.
+*/
+OBJECT(internPool, char* arena; unsigned int used; unsigned int capacity; unsigned int* offsets; unsigned int* lengths; unsigned int num; unsigned int limit; unsigned int* index; unsigned int indexLimit;);
+FUNCTION(internPool, intern, unsigned int, const char*, unsigned int); //ID of the first length characters of the text, added if new.
+FUNCTION(internPool, text, const char*, unsigned int); //text of an ID.
+FUNCTION(internPool, length, unsigned int, unsigned int); //length of an ID's text.
+FUNCTION(internPool, slice, slice, unsigned int); //text and length of an ID as one view.
+FUNCTION_NOARG(internPool, grow, void); //doubles the index and rehashes every ID.
+FUNCTION(internPool, reserve, void, unsigned int); //room for count IDs without growing.
+
+/*
+* Flat symbol table. Symbols are at most 6 characters (see isSymbolText) so each symbol is packed into a single 64-bit key
+* and stored inline with its line and address in one open-addressed array. A key of 0 marks an empty slot.
+*/
+typedef struct symbol { unsigned long long key; unsigned int name; unsigned int line; unsigned int address; } symbol; //name is an internPool ID.
+OBJECT(symbolTable, symbol* entries; unsigned int num; unsigned int limit; probeStats stats;);
+STATIC_FUNCTION(symbolTable, pack, unsigned long long, const char*, unsigned int); //packs up to 6 characters into a key, 0 if it can't be a symbol.
+FUNCTION(symbolTable, define, bool, internPool*, unsigned int, unsigned int, unsigned int); //adds symbol ID (line, address), false if it already exists.
+FUNCTION(symbolTable, find, symbol*, const char*, unsigned int); //borrowed pointer to the entry, NULL if not defined.
+FUNCTION(symbolTable, lookup, symbol*, unsigned long long); //find by packed key.
+FUNCTION_NOARG(symbolTable, grow, void);
+FUNCTION(symbolTable, reserve, void, unsigned int); //room for count symbols without growing.
 
 OBJECT(file, FILE* handle;);
 FUNCTION(file, open, void, const char*, const char*);
 FUNCTION_NOARG(file, close, void);
-FUNCTION_NOARG(file, length, int);
-FUNCTION(file, readAll, void, string* str);
 
-OBJECT(instruction, string* symbol; string* opcode; string* operand; string* comment; unsigned int line;);
+/*
+* What the structural scan found on one line: its length, where its first three tabs are (offset in the line + 1, 0 = no such tab)
+* and whether the line has a comma or is a comment. tokenizeLine cuts columns here instead of searching again.
+* LINEMAP_LONG marks a tab past the 254th byte, the tokenizer searches that line itself.
+*/
+typedef struct lineMap { unsigned int length; unsigned char tabs[3]; unsigned char flags; } lineMap;
+enum { LINEMAP_COMMAS = 1, LINEMAP_COMMENT = 2, LINEMAP_LONG = 4 };
+
+/*
+* Read-only view of a source file. The file is memory mapped where the platform allows it (read into one buffer otherwise)
+* and indexed by one pass of the scan kernel into a lineMap per line, so the source is never copied or split into strings.
+* Lines are walked in order, offset is the 64-bit position of the next one so sources over 4 GB work, a single line still
+* has to fit an unsigned int. Like the old string read, the text ends at the first NUL byte.
+* source_stream instead reads the file SOURCE_CHUNK bytes at a time and only ever holds (and indexes) the current chunk or
+* longest line, so memory stays flat however big the file is. Either way source_next walks the lines in order and
+* source_rewind starts over.
+*/
+#ifndef SOURCE_CHUNK
+#define SOURCE_CHUNK (1 << 16)
+#endif
+OBJECT(source, const char* text; unsigned long long length; lineMap* index; unsigned int indexLimit; unsigned int lines; unsigned int labels; bool mapped; unsigned long long mappedLength;
+	unsigned long long offset; unsigned int cursor; unsigned int line; bool last; FILE* stream; char* chunk; unsigned long long chunkLimit; unsigned long long chunkStart; unsigned long long chunkUsed; bool streamEnded; bool tailIndexed;);
+FUNCTION(source, open, bool, const char*); //maps and indexes the file, false if it can't be read or is empty.
+FUNCTION(source, stream, bool, const char*); //opens the file for chunked reading, false if it can't be read or is empty.
+FUNCTION(source, next, bool, const char**, unsigned int*, const lineMap**); //next line (not NUL terminated) and its map, sets line (1 based) and last. false once every line was read.
+FUNCTION_NOARG(source, rewind, bool); //back to the first line, false if the input can't be read again.
+FUNCTION_NOARG(source, close, void);
+
+/*
+* One source line cut into its columns by tokenizeLine. Every field is a slice of the line itself, so tokenizing allocates nothing
+* and the fields are only valid as long as the line is. operandBase is the operand up to its first comma, indexed is set for a
+* ",X" suffix and badIndex for any other single suffix. BYTE literals are left to lexToken.
+*/
+typedef enum lineKind { LINE_BLANK, LINE_COMMENT, LINE_INSTRUCTION } lineKind;
+typedef struct lineTokens {
+	slice label; slice mnemonic; slice operand; slice comment;
+	slice operandBase; bool indexed; bool badIndex;
+} lineTokens;
+
+/*
+* An operand as pass 1 decoded it, so pass 2 never parses text: an operandKind plus the OPERAND_INDEXED / OPERAND_BAD_INDEX
+* flags in one byte and a value. The value is the number for OPERAND_NUMBER (hex for instructions, the decimal of WORD, RESB
+* and RESW), the packed symbolTable key for OPERAND_SYMBOL and the payload length of a BYTE literal, which starts 2 characters
+* into the operand. OPERAND_INVALID keeps the partial hex value like strtoul did.
+*/
+typedef enum operandKind { OPERAND_NONE, OPERAND_NUMBER, OPERAND_SYMBOL, OPERAND_INVALID, OPERAND_CHARS, OPERAND_BYTES } operandKind;
+enum { OPERAND_KIND_MASK = 7, OPERAND_INDEXED = 8, OPERAND_BAD_INDEX = 16 };
+
+/*
+* Columnar store of every instruction pass 1 accepted, in source order. One parallel array per field keeps pass 2 a linear walk
+* over a few dense arrays instead of chasing an instruction and its strings per line. Text fields are internPool IDs,
+* ids / codes are what pass 1 classified the mnemonic as (an instructionId and the machine opcode, 0 for directives),
+* operandKinds / operandValues the decoded operand.
+* Comments are only kept (in one side buffer) when built with KEEP_COMMENTS, pass 2 never reads them.
+*/
+#ifndef KEEP_COMMENTS
+#define KEEP_COMMENTS 0
+#endif
+OBJECT(instructionStore, unsigned int num; unsigned int limit; unsigned int* lines; unsigned int* labels; unsigned int* opcodes; unsigned int* operands; unsigned int* addresses; unsigned char* ids; unsigned char* codes; unsigned char* operandKinds; unsigned long long* operandValues; unsigned int* comments; string* commentText;);
+FUNCTION(instructionStore, push, unsigned int, const lineTokens*, internPool*, unsigned int, unsigned int, unsigned int, unsigned int, unsigned char, unsigned long long); //appends a tokenized line (line number, address, id, code, decoded operand), returns its index.
+FUNCTION(instructionStore, comment, const char*, unsigned int); //comment of an instruction, "" unless KEEP_COMMENTS.
+FUNCTION_NOARG(instructionStore, grow, void);
+FUNCTION(instructionStore, reserve, void, unsigned int); //room for count instructions without growing.
 
 void* rvalue_to_lvalue(void* rvalue, unsigned int sizeof_rvalue)
 {
@@ -160,524 +609,1257 @@ rvalue_to_lvalue(A, sizeof(A))
 #pragma region literals
 
 
-typedef struct opcodes
-{
-	const char* mnemonic;
-	unsigned int value;
-} opcodes;
-
-static const opcodes instructions[] = {
-	{"ADD", 0x18}, {"ADDF",0x58}, {"ADDR", 0x90}, {"AND", 0x40}, {"CLEAR", 0xB4}, {"COMP", 0x28}, {"COMPF", 0x88},
-	{"COMPR", 0xA0}, {"DIV", 0x24}, {"DIVF", 0x64}, {"DIVR", 0x9C}, {"FIX", 0xC4}, {"FLOAT", 0xC0}, {"HIO", 0xC0},
-	{"J", 0x3C}, {"JEQ", 0x30}, {"JGT", 0x34}, {"JLT", 0x38}, {"JSUB", 0x48}, {"LDA", 0x00}, {"LDB", 0x68}, {"LDCH", 0x50},
-	{"LDF", 0x70}, {"LDL", 0x08}, {"LDS", 0x6C}, {"LDT", 0x74}, {"LDX", 0x04}, {"LPS", 0xD0}, {"MUL", 0x20}, {"MULF", 0x60},
-	{"MULR", 0x98}, {"NORM",0xC8}, {"OR",0x44}, {"RD",0xD8}, {"RMO", 0xAC}, {"RSUB", 0x4C}, {"SHIFTL", 0xA4}, {"SHIFTR", 0xA8},
-	{"SIO", 0xF0}, {"SSK", 0xEC}, {"STA", 0x0C}, {"STB", 0x78}, {"STCH", 0x54}, {"STF", 0x80}, {"STI", 0xD4},
-	{"STL", 0x14}, {"STS", 0x7C}, {"STSW", 0xE8}, {"STT", 0x84}, {"STX", 0x10}, {"SUB", 0x1C}, {"SUBF", 0x5C},
-	{"SUBR", 0x94},{"SVC", 0xB0}, {"TD", 0xE0}, {"TIO", 0xF8} ,{"TIX", 0x2C}, {"TIXR", 0xB8},{ "WD", 0xDC}
-};
-
+/*
+* Packs up to 8 characters of a mnemonic into one integer (first character in the highest used byte), see packMnemonic.
+* Kn spell the same packing out as integer constant expressions so they can be used as case labels.
+*/
+#define K1(a) ((unsigned long long)(unsigned char)(a))
+#define K2(a,b) ((K1(a) << 8) | K1(b))
+#define K3(a,b,c) ((K2(a,b) << 8) | K1(c))
+#define K4(a,b,c,d) ((K3(a,b,c) << 8) | K1(d))
+#define K5(a,b,c,d,e) ((K4(a,b,c,d) << 8) | K1(e))
+#define K6(a,b,c,d,e,f) ((K5(a,b,c,d,e) << 8) | K1(f))
+#define K7(a,b,c,d,e,f,g) ((K6(a,b,c,d,e,f) << 8) | K1(g))
 
-static const unsigned char totalInstructions = 59;
+/*
+* X(mnemonic, value, packed mnemonic). The classifyMnemonic switch is generated from these lists,
+* so the packed spelling must match the mnemonic string (colliding keys fail to compile as duplicate case labels).
+*/
+#define SIC_INSTRUCTIONS(X) \
+	X("ADD", 0x18, K3('A','D','D')) X("ADDF", 0x58, K4('A','D','D','F')) X("ADDR", 0x90, K4('A','D','D','R')) \
+	X("AND", 0x40, K3('A','N','D')) X("CLEAR", 0xB4, K5('C','L','E','A','R')) X("COMP", 0x28, K4('C','O','M','P')) \
+	X("COMPF", 0x88, K5('C','O','M','P','F')) X("COMPR", 0xA0, K5('C','O','M','P','R')) X("DIV", 0x24, K3('D','I','V')) \
+	X("DIVF", 0x64, K4('D','I','V','F')) X("DIVR", 0x9C, K4('D','I','V','R')) X("FIX", 0xC4, K3('F','I','X')) \
+	X("FLOAT", 0xC0, K5('F','L','O','A','T')) X("HIO", 0xC0, K3('H','I','O')) X("J", 0x3C, K1('J')) \
+	X("JEQ", 0x30, K3('J','E','Q')) X("JGT", 0x34, K3('J','G','T')) X("JLT", 0x38, K3('J','L','T')) \
+	X("JSUB", 0x48, K4('J','S','U','B')) X("LDA", 0x00, K3('L','D','A')) X("LDB", 0x68, K3('L','D','B')) \
+	X("LDCH", 0x50, K4('L','D','C','H')) X("LDF", 0x70, K3('L','D','F')) X("LDL", 0x08, K3('L','D','L')) \
+	X("LDS", 0x6C, K3('L','D','S')) X("LDT", 0x74, K3('L','D','T')) X("LDX", 0x04, K3('L','D','X')) \
+	X("LPS", 0xD0, K3('L','P','S')) X("MUL", 0x20, K3('M','U','L')) X("MULF", 0x60, K4('M','U','L','F')) \
+	X("MULR", 0x98, K4('M','U','L','R')) X("NORM", 0xC8, K4('N','O','R','M')) X("OR", 0x44, K2('O','R')) \
+	X("RD", 0xD8, K2('R','D')) X("RMO", 0xAC, K3('R','M','O')) X("RSUB", 0x4C, K4('R','S','U','B')) \
+	X("SHIFTL", 0xA4, K6('S','H','I','F','T','L')) X("SHIFTR", 0xA8, K6('S','H','I','F','T','R')) X("SIO", 0xF0, K3('S','I','O')) \
+	X("SSK", 0xEC, K3('S','S','K')) X("STA", 0x0C, K3('S','T','A')) X("STB", 0x78, K3('S','T','B')) \
+	X("STCH", 0x54, K4('S','T','C','H')) X("STF", 0x80, K3('S','T','F')) X("STI", 0xD4, K3('S','T','I')) \
+	X("STL", 0x14, K3('S','T','L')) X("STS", 0x7C, K3('S','T','S')) X("STSW", 0xE8, K4('S','T','S','W')) \
+	X("STT", 0x84, K3('S','T','T')) X("STX", 0x10, K3('S','T','X')) X("SUB", 0x1C, K3('S','U','B')) \
+	X("SUBF", 0x5C, K4('S','U','B','F')) X("SUBR", 0x94, K4('S','U','B','R')) X("SVC", 0xB0, K3('S','V','C')) \
+	X("TD", 0xE0, K2('T','D')) X("TIO", 0xF8, K3('T','I','O')) X("TIX", 0x2C, K3('T','I','X')) \
+	X("TIXR", 0xB8, K4('T','I','X','R')) X("WD", 0xDC, K2('W','D'))
+
+typedef enum directiveType {
+	DIRECTIVE_END, DIRECTIVE_BYTE, DIRECTIVE_WORD, DIRECTIVE_RESB, DIRECTIVE_RESW, DIRECTIVE_RESR, DIRECTIVE_EXPORTS, DIRECTIVE_START, DIRECTIVE_COUNT
+} directiveType;
+
+/* compact ID pass 1 records per instruction: a directive's directiveType, INSTRUCTION_OPCODE for machine instructions. pass2Emitters is indexed by it. */
+typedef enum instructionId { INSTRUCTION_OPCODE = DIRECTIVE_COUNT, INSTRUCTION_UNKNOWN, INSTRUCTION_IDS } instructionId;
+
+#define SIC_DIRECTIVES(X) \
+	X("END", DIRECTIVE_END, K3('E','N','D')) X("BYTE", DIRECTIVE_BYTE, K4('B','Y','T','E')) X("WORD", DIRECTIVE_WORD, K4('W','O','R','D')) \
+	X("RESB", DIRECTIVE_RESB, K4('R','E','S','B')) X("RESW", DIRECTIVE_RESW, K4('R','E','S','W')) X("RESR", DIRECTIVE_RESR, K4('R','E','S','R')) \
+	X("EXPORTS", DIRECTIVE_EXPORTS, K7('E','X','P','O','R','T','S')) X("START", DIRECTIVE_START, K5('S','T','A','R','T'))
 
-static const char* directives[] = {
-	"END", "BYTE", "WORD", "RESB", "RESW", "RESR", "EXPORTS", "START"
+/*
+* Character classes for lexToken, every byte is in exactly one. A class holds the bytes no rule tells apart, so a byte with several
+* roles gets its own: 'C' is a letter, a hex digit and the C'..' prefix. CC_BLANK, CC_PLUS, CC_MINUS and CC_INVALID are the
+* characters a symbol can't contain (' ', '+', '-', '$', '!', '=', '(', ')', '@').
+*/
+typedef enum charClass {
+	CC_OTHER, CC_BLANK, CC_SPACE, CC_PLUS, CC_MINUS, CC_INVALID, CC_ZERO, CC_DIGIT,
+	CC_HEX_UPPER, CC_HEX_LOWER, CC_C, CC_X, CC_SMALL_X, CC_UPPER, CC_QUOTE, CC_HASH, CC_COUNT
+} charClass;
+
+static const unsigned char charClasses[256] = {
+	[' '] = CC_BLANK, ['\t'] = CC_SPACE, ['\n'] = CC_SPACE, ['\v'] = CC_SPACE, ['\f'] = CC_SPACE, ['\r'] = CC_SPACE,
+	['+'] = CC_PLUS, ['-'] = CC_MINUS, ['$'] = CC_INVALID, ['!'] = CC_INVALID, ['='] = CC_INVALID, ['('] = CC_INVALID,
+	[')'] = CC_INVALID, ['@'] = CC_INVALID, ['\''] = CC_QUOTE, ['#'] = CC_HASH,
+	['0'] = CC_ZERO, ['1'] = CC_DIGIT, ['2'] = CC_DIGIT, ['3'] = CC_DIGIT, ['4'] = CC_DIGIT, ['5'] = CC_DIGIT, ['6'] = CC_DIGIT,
+	['7'] = CC_DIGIT, ['8'] = CC_DIGIT, ['9'] = CC_DIGIT,
+	['A'] = CC_HEX_UPPER, ['B'] = CC_HEX_UPPER, ['C'] = CC_C, ['D'] = CC_HEX_UPPER, ['E'] = CC_HEX_UPPER, ['F'] = CC_HEX_UPPER,
+	['a'] = CC_HEX_LOWER, ['b'] = CC_HEX_LOWER, ['c'] = CC_HEX_LOWER, ['d'] = CC_HEX_LOWER, ['e'] = CC_HEX_LOWER, ['f'] = CC_HEX_LOWER,
+	['X'] = CC_X, ['x'] = CC_SMALL_X,
+	['G'] = CC_UPPER, ['H'] = CC_UPPER, ['I'] = CC_UPPER, ['J'] = CC_UPPER, ['K'] = CC_UPPER, ['L'] = CC_UPPER, ['M'] = CC_UPPER,
+	['N'] = CC_UPPER, ['O'] = CC_UPPER, ['P'] = CC_UPPER, ['Q'] = CC_UPPER, ['R'] = CC_UPPER, ['S'] = CC_UPPER, ['T'] = CC_UPPER,
+	['U'] = CC_UPPER, ['V'] = CC_UPPER, ['W'] = CC_UPPER, ['Y'] = CC_UPPER, ['Z'] = CC_UPPER
 };
-static const unsigned char totalDirectives = 8;
 
-static const char invalidSymbolCharacters[] = { ' ', '$', '!', '=', '+', '-', '(', ')', '@' };
-static const unsigned char totalInvalidSymbolCharacters = 9;
+/* value of a hex (so also decimal) digit, 0 for every other byte. */
+static const unsigned char digitValues[256] = {
+	['1'] = 1, ['2'] = 2, ['3'] = 3, ['4'] = 4, ['5'] = 5, ['6'] = 6, ['7'] = 7, ['8'] = 8, ['9'] = 9,
+	['A'] = 10, ['B'] = 11, ['C'] = 12, ['D'] = 13, ['E'] = 14, ['F'] = 15,
+	['a'] = 10, ['b'] = 11, ['c'] = 12, ['d'] = 13, ['e'] = 14, ['f'] = 15
+};
 
 static const char whitespace[] = { ' ', '\r', '\n' };
 int totalWhitespace = 3;
 
-#define MIN_ALPHA 0x41 //A
-#define MAX_ALPHA 0x5A //Z
-
 #pragma endregion
 
 #pragma region helpers
 
 #pragma region general
 
-bool fromHex(const char* who, unsigned long* val)
+void hexEncode(const unsigned char* bytes, unsigned int length, char* out);
+
+/* same text as "%0<width>X" into out (up to 8 characters, not NUL terminated), returns how many were written. */
+unsigned int formatHex(char* out, unsigned int value, unsigned int width)
 {
-	char* end;
-	*val = strtoul(who, &end, 16);
-	return (*who != '\0' && *end == '\0');
+	char digits[8];
+	unsigned int count = 0;
+	do {
+		digits[count++] = "0123456789ABCDEF"[value & 0xF];
+		value >>= 4;
+	} while (value != 0);
+	unsigned int total = count > width ? count : width;
+	for (unsigned int i = count; i < total; ++i)
+		*out++ = '0';
+	while (count > 0)
+		*out++ = digits[--count];
+	return total;
 }
 
-void toHex(char* who, string* val)
+/* hex text of the characters into out, which needs room for 8 per character. Returns its length. */
+unsigned int toHex(const char* who, unsigned int length, char* out)
 {
-	unsigned int accumulator = 0;
-	while (who[accumulator] != 0)
-		string_format(val, "%02X", who[accumulator++]);
+	const unsigned char* bytes = (const unsigned char*)who;
+	unsigned int done = 0, written = 0;
+	while (done < length)
+	{
+		unsigned int run = done;
+		while (run < length && bytes[run] < 0x80)
+			++run;
+		hexEncode(bytes + done, run - done, out + written);
+		written += 2 * (run - done);
+		if (run < length)
+			written += formatHex(out + written, (unsigned int)who[run++], 2); //sign extends like the old "%02X" did.
+		done = run;
+	}
+	return written;
 }
 
-bool fromDecimal(const char* who, long* val)
+/* length of toHex's text without writing it. */
+unsigned int toHexLength(const char* who, unsigned int length)
 {
-	char* end;
-	*val = strtol(who, &end, 10); //ez checks
-	return (*who != '\0' && *end == '\0');
+	unsigned int written = 2 * length;
+	if (CHAR_MIN < 0) /* only a signed char sign extends */
+		for (unsigned int i = 0; i < length; ++i)
+			written += (unsigned char)who[i] >= 0x80 ? 6 : 0;
+	return written;
 }
 
-string* removeWhitespace(string* str) //functional
+bool sliceIs(slice who, const char* text)
 {
-	for (int i = str->length - 1; i >= 0; --i)
-	{
-		bool cont = false;
-		if (str->c_str[i] == 0)
-			continue; //next;
-		for (int j = 0; j < totalWhitespace; j++)
-		{
-			if (str->c_str[i] == whitespace[j])
-			{
-				str->c_str[i] = 0; /* juuuust in case. */
-				cont = true;
-				break;
-			}
-		}
-		if (!cont)
-			break;
-	}
-	str->length = strlen(str->c_str);
-	return str;
+	unsigned int length = (unsigned int)strlen(text);
+	return who.length == length && memcmp(who.text, text, length) == 0;
 }
 
-#pragma endregion
+/* length without trailing spaces and line breaks. */
+unsigned int trimmedLength(const char* text, unsigned int length)
+{
+	while (length > 0 && VALID(memchr(whitespace, text[length - 1], totalWhitespace)))
+		--length;
+	return length;
+}
 
-#pragma region pass one
+/*
+* Diagnostics. Everything the assembler reports goes through report(), which prints to stdout unless the calling thread
+* has captured its diagnostics into a string, so assemblies running side by side don't interleave their output.
+* redirectDiagnostics moves the uncaptured output to another stream (stderr while stdout carries object records).
+*/
+THREAD_LOCAL string* ___diagnostics = NULL;
+THREAD_LOCAL FILE* ___diagnosticsStream = NULL; //NULL = stdout.
 
-bool isDirective(string* who)
+string* captureDiagnostics(string* into) /* NULL = back to stdout, returns the previous sink */
 {
-	if (!VALID(who))
-		return false;
-	for (int i = 0; i < totalDirectives; ++i)
-		if (strcmp(who->c_str, directives[i]) == 0)
-			return true;
-	return false;
+	string* previous = ___diagnostics;
+	___diagnostics = into;
+	return previous;
 }
 
-#define nullptr 0
-
-bool isOPCode(string* who, int* out)
+FILE* redirectDiagnostics(FILE* into) /* NULL = back to stdout, returns the previous stream */
 {
-	if (!VALID(who))
-		return false;
-	for (int i = 0; i < totalInstructions; ++i)
-		if (strcmp(who->c_str, instructions[i].mnemonic) == 0)
-		{
-			if (out)
-			{
-				*out = instructions[i].value;
-			}
-			return true;
-		}
-	return false;
+	FILE* previous = ___diagnosticsStream;
+	___diagnosticsStream = into;
+	return previous;
 }
 
-bool isSymbol(string* who)
+void report(const char* format, ...)
 {
-	if (!VALID(who) || who->length > 6)
-		return false;
-	char c = who->c_str[0];
-	if (MIN_ALPHA > c || c > MAX_ALPHA)
-		return false;
+	va_list args;
+	va_start(args, format);
+	if (VALID(___diagnostics))
+		string_vformat(___diagnostics, format, args);
+	else
+		vfprintf(VALID(___diagnosticsStream) ? ___diagnosticsStream : stdout, format, args);
+	va_end(args);
+}
 
-	for (unsigned int i = 1; i < who->length; ++i)
-	{
-		c = who->c_str[i];
-		for (unsigned int j = 0; j < totalInvalidSymbolCharacters; ++j)
-		{
-			char o = invalidSymbolCharacters[j];
-			if (c == o)
-				return false;
-		}
-	}
-	return !isDirective(who);
+void probeStats_record(probeStats* stats, unsigned int probes)
+{
+	++stats->lookups;
+	stats->probes += probes;
+	if (probes > stats->longest)
+		stats->longest = probes;
 }
 
-bool isComment(string* who)
+void probeStats_print(const char* name, const probeStats* stats, unsigned int num, unsigned int limit, unsigned int tombstones)
 {
-	if (!VALID(who) || who->c_str[0] != '#')
-		return false;
-	return true;
+	report("%s%s%s: %u entries, %u buckets (%u%% full, %u tombstones), %lu lookups, %.2f avg probes, %u longest%s",
+		LIGHT_CYAN, name, RESET, num, limit, limit == 0 ? 0 : (unsigned int)((unsigned long)num * 100 / limit), tombstones,
+		stats->lookups, stats->lookups == 0 ? 0.0 : (double)stats->probes / stats->lookups, stats->longest, NEWLINE);
 }
 
-bool isOperand(string* who)
+#pragma endregion
+
+#pragma region scanning
+/*
+* Structural scan kernel. One pass over 64 bytes of source yields a bitmask per character class (bit i = byte i), which
+* source_index turns into the line index. X(mask, character) lists the classes, every kernel is generated from it.
+* The kernel is picked on first use: AVX2 or SSE2 on x86-64 (SSE2 is always there). The scalar level has no kernel,
+* source_index walks the lines with memchr there, which beats classifying every byte one at a time.
+*/
+#define SCAN_CLASSES(X) X(newlines, '\n') X(tabs, '\t') X(commas, ',') X(hashes, '#') X(nuls, '\0') X(spaces, ' ') X(returns, '\r')
+
+#define AS_SCAN_FIELD(MASK, CHARACTER) unsigned long long MASK;
+typedef struct scanMasks { SCAN_CLASSES(AS_SCAN_FIELD) } scanMasks;
+#undef AS_SCAN_FIELD
+typedef void (*scanKernel)(const char* block, scanMasks* masks); //block is 64 readable bytes.
+
+typedef enum scanLevel { SCAN_SCALAR, SCAN_SSE2, SCAN_AVX2 } scanLevel;
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SCAN_X86 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#define SCAN_TARGET_AVX2
+#else
+#define SCAN_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+static void scanBlock_sse2(const char* block, scanMasks* masks)
 {
-	return (!isComment(who) && !isDirective(who) && !isOPCode(who, nullptr));
+	scanMasks found = { 0 };
+	for (unsigned int i = 0; i < 4; ++i)
+	{
+		__m128i bytes = _mm_loadu_si128((const __m128i*)(block + i * 16));
+#define AS_SCAN_SSE2(MASK, CHARACTER) found.MASK |= (unsigned long long)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(CHARACTER))) << (i * 16);
+		SCAN_CLASSES(AS_SCAN_SSE2)
+#undef AS_SCAN_SSE2
+	}
+	*masks = found;
 }
 
-void parseInstruction(instruction* parsed, string* what)
+SCAN_TARGET_AVX2 static void scanBlock_avx2(const char* block, scanMasks* masks)
 {
-	vector* columns = NEW(vector);
-	string_split(what, columns, "\t");
-	switch (columns->num > 4 ? 4 : columns->num)
+	scanMasks found = { 0 };
+	for (unsigned int i = 0; i < 2; ++i)
 	{
-	case 4:
-		string_append(parsed->comment, removeWhitespace(((string*)columns->data[3]))->c_str);
-	case 3:
-		string_append(parsed->operand, removeWhitespace(((string*)columns->data[2]))->c_str);
-	case 2:
-		string_append(parsed->opcode, removeWhitespace(((string*)columns->data[1]))->c_str);
-	case 1:
-		string_append(parsed->symbol, removeWhitespace(((string*)columns->data[0]))->c_str);
+		__m256i bytes = _mm256_loadu_si256((const __m256i*)(block + i * 32));
+#define AS_SCAN_AVX2(MASK, CHARACTER) found.MASK |= (unsigned long long)(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(CHARACTER))) << (i * 32);
+		SCAN_CLASSES(AS_SCAN_AVX2)
+#undef AS_SCAN_AVX2
 	}
-	DELETE(columns);
+	*masks = found;
 }
+#else
+#define SCAN_X86 0
+#endif
 
-#pragma endregion
+static const struct { const char* name; scanKernel kernel; } scanKernels[] = {
+	{ "scalar", NULL }, /* memchr, see source_indexLines */
+#if SCAN_X86
+	{ "sse2", scanBlock_sse2 },
+	{ "avx2", scanBlock_avx2 },
+#endif
+};
 
-#pragma endregion
+scanLevel scanSupported() /* widest kernel this CPU runs */
+{
+#if SCAN_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return SCAN_SSE2;
+	__cpuid(info, 1);
+	bool osSavesYmm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+	__cpuidex(info, 7, 0);
+	return osSavesYmm && (info[1] & (1 << 5)) != 0 ? SCAN_AVX2 : SCAN_SSE2;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") ? SCAN_AVX2 : SCAN_SSE2;
+#endif
+#else
+	return SCAN_SCALAR;
+#endif
+}
 
-typedef struct program {
-	unsigned long start;
-	unsigned long end;
-	unsigned long firstInstruction;
-	string* name;
-	hashTable* symtab;
-	vector* instructions;
-	vector* warnings;
-} program;
+static unsigned long ___scanLevel = 0; //chosen level + 1, 0 until the first scan.
 
-unsigned int mnemonicToOpCode(string* opcode)
+void scanUse(scanLevel level) /* overrides the pick (benchmarks), capped at what the CPU supports */
 {
-	if (!VALID(opcode))
-		return 0;
-	for (int i = 0; i < totalInstructions; ++i)
-		if (strcmp(opcode->c_str, instructions[i].mnemonic) == 0)
-			return instructions[i].value;
-	return 0;
+	scanLevel supported = scanSupported();
+	unsigned long chosen = (level > supported ? supported : level) + 1;
+	while (!___atomicSwap(&___scanLevel, ___atomicLoad(&___scanLevel), chosen));
 }
 
-bool operandToValue(string* operand, program* programData, unsigned long* value)
+scanKernel scanSelected()
 {
-	vector* data = NEW(vector);
-	string_split(operand, data, ",");
-	string* operand_value = (string*)data->data[0];
-	if (isSymbol(operand_value))
+	unsigned long level = ___atomicLoad(&___scanLevel);
+	if (level == 0)
 	{
-		if (hashTable_has(programData->symtab, operand_value->c_str))
-		{
-			bucket* hashData = hashTable_get(programData->symtab, operand_value->c_str);
-			*value = hashData->second->second;
-			DELETE(hashData);
-		}
-		else {
-			DELETE(data);
-			return false;
-		}
-	}
-	else {
-		switch (operand_value->length)
-		{
-		case 0:
-			*value = 0;
-			break;
-		default:
-			if (!fromHex(operand_value->c_str, value))
-			{
-				DELETE(data);
-				return false;
-			}
-			break;
-		}
+		___atomicSwap(&___scanLevel, 0, scanSupported() + 1); /* every thread picks the same, first one wins */
+		level = ___atomicLoad(&___scanLevel);
 	}
+	return scanKernels[level - 1].kernel;
+}
 
-	if (data->num == 2)
-	{
-
-		if (strcmp(((string*)data->data[1])->c_str, "X") != 0)
-		{
-			DELETE(data);
-			return false;
-		}
-		else
-			*value |= 0x8000; //set upper 8th bit for indexed mode
-	}
+unsigned int lowestBit(unsigned long long mask) /* index of the lowest set bit, mask != 0 */
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	unsigned long index;
+	_BitScanForward64(&index, mask);
+	return (unsigned int)index;
+#else
+	return (unsigned int)__builtin_ctzll(mask);
+#endif
+}
 
-	DELETE(data);
-	return true;
+unsigned int bitCount(unsigned long long mask)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	return (unsigned int)__popcnt64(mask);
+#else
+	return (unsigned int)__builtin_popcountll(mask);
+#endif
 }
 
-void printWarnings(vector* warnings)
+unsigned long long lowBits(unsigned int count) /* mask of the lowest count bits, count <= 64 */
 {
-	printf("\n %s%i%s WARNINGS DETECTED%s", LIGHT_CYAN, warnings->num, YELLOW, NEWLINE);
+	return count >= 64 ? ~0ULL : (1ULL << count) - 1;
+}
+#pragma endregion
 
-	printf("┌────────────────────────┐\n");
-	printf("│ \33[7m%sWARRNING SUMMARY BELOW\33[27m%s │%s", YELLOW, RESET, NEWLINE);
-	printf("└────────────────────────┘\n");
+#pragma region hex
+/*
+* Hex kernels. hexEncode writes two uppercase digits per byte: SSE2 does 16 bytes a step on x86-64, the SWAR kernel 4 bytes
+* in a 64-bit word elsewhere (little endian only) and the scalar loop is the reference the benchmark checks both against.
+* parseHex / parseDecimal read the common short literal (1 to 8 plain digits, decimal may have a sign) as one word and
+* return false for anything else, callers fall back to lexToken which has every strtoul / strtol corner case.
+*/
+typedef void (*hexKernel)(const unsigned char* bytes, unsigned int length, char* out);
 
-	for (unsigned int i = 0; i < warnings->num; ++i)
+static void hexEncode_scalar(const unsigned char* bytes, unsigned int length, char* out)
+{
+	for (unsigned int i = 0; i < length; ++i)
 	{
-		string* warning = (string*)warnings->data[i];
-		printf(" %s%u.%s %s", LIGHT_CYAN, i + 1, RESET, warning->c_str);
+		out[2 * i] = "0123456789ABCDEF"[bytes[i] >> 4];
+		out[2 * i + 1] = "0123456789ABCDEF"[bytes[i] & 0xF];
 	}
 }
 
-bool pass1(vector* lines, program* programData)
+static bool littleEndian()
 {
-	vector* errors = NEW(vector);
-	vector* symbols = NEW(vector);
-
-	bool explicitStart = false; bool addressExceeded = false;  bool explicitEnd = false; unsigned int totalInstructions = 0;
+	const unsigned int one = 1;
+	return *(const unsigned char*)&one == 1;
+}
 
-	for (unsigned int i = 0; i < lines->num; ++i)
+static void hexEncode_swar(const unsigned char* bytes, unsigned int length, char* out)
+{
+	unsigned int i = 0;
+	if (littleEndian())
 	{
-		string* text = (string*)lines->data[i];
-		unsigned int line = i + 1;
-		//why <= 1? whitepace on one of the test files. A proper solution would be to remove leading and trailing whitespace,,,, TODO!
-		if (removeWhitespace(text)->length < 1) //ignore last line potential whitespace.
+		for (; i + 4 <= length; i += 4)
 		{
-			if (i != lines->num - 1)
-				vector_push_back(errors, (object*)string_make_and_format("%sLINE %s%i%s WAS EMPTY!%s", LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, NEWLINE));
-		}	
-		else {
+			unsigned int word;
+			memcpy(&word, bytes + i, 4);
+			unsigned long long spread = word;
+			spread = (spread | spread << 16) & 0x0000FFFF0000FFFFULL;
+			spread = (spread | spread << 8) & 0x00FF00FF00FF00FFULL; /* byte k alone in 16-bit lane k */
+			unsigned long long nibbles = ((spread >> 4) & 0x000F000F000F000FULL) | ((spread & 0x000F000F000F000FULL) << 8);
+			unsigned long long letters = ((nibbles + 0x0606060606060606ULL) >> 4) & 0x0101010101010101ULL; /* 1 per nibble > 9 */
+			unsigned long long digits = nibbles + 0x3030303030303030ULL + letters * ('A' - '0' - 10);
+			memcpy(out + 2 * i, &digits, 8);
+		}
+	}
+	hexEncode_scalar(bytes + i, length - i, out + 2 * i);
+}
 
-			if (isComment(text)) //comment
-				continue;
-			if (explicitEnd) /* program has ended! */
-			{
-				vector_push_back(programData->warnings, (object*)string_make_and_format("%sINSTRUCTION ON LINE %s%i%s IS AFTER %sEND%s AND IS IGNORED%s", YELLOW, LIGHT_CYAN, line, YELLOW, LIGHT_CYAN, YELLOW, NEWLINE));
-				continue;
-			}
-			if (!addressExceeded && programData->end >= 0x8000)
-			{
-				addressExceeded = true;
-				vector_push_back(errors, (object*)string_make_and_format("%sMAXIMUM ADDRESSABLE MEMORY EXCEEDED %s%X%s >= %s%X%s BY LINE %s%i%s!%s",
-					LIGHT_RED, LIGHT_CYAN, programData->end, LIGHT_RED, LIGHT_CYAN, 0x8000, LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, NEWLINE));
-			}
-			instruction* parsed = NEW(instruction);
-			parseInstruction(parsed, text);
-			parsed->line = line;
-			if (programData->firstInstruction == (long unsigned int) -1 && parsed->opcode->length != 0 && isOPCode(parsed->opcode, nullptr))
-				programData->firstInstruction = programData->end;
-			++totalInstructions;
-			switch (totalInstructions)
-			{
-			case 1:
-				if (strcmp(parsed->opcode->c_str, "START") == 0)
-				{
-					if (parsed->operand->length == 0)
-						vector_push_back(errors, (object*)string_make_and_format("%sLINE %s%i%s MISSING OPERAND!%s", LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, NEWLINE));
-					else if (parsed->operand->c_str[0] == '-')
-						vector_push_back(errors, (object*)string_make_and_format("%sLINE %s%i%s CONTAINS INVALID HEXADECIMAL %s%s%s < %s0%s%s",
-							LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, LIGHT_CYAN, parsed->operand->c_str, LIGHT_RED, LIGHT_CYAN, LIGHT_RED, NEWLINE));
-					else if (!fromHex(parsed->operand->c_str, &programData->end))
-					{
-						vector_push_back(errors, (object*)string_make_and_format("%sLINE %s%i%s CONTAINS INVALID HEXADECIMAL %s%s%s!%s",
-							LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, LIGHT_CYAN, parsed->operand->c_str, LIGHT_RED, NEWLINE));
-					}
-					else {
-						explicitStart = true;
-						programData->start = programData->end;
-						string_append(programData->name, parsed->symbol->c_str);
-					}
-				}
-			/* fall through */
-			default:
-				if (parsed->symbol->length != 0)
-				{
-					if (!isSymbol(parsed->symbol))
-					{
-						string* errorMessage = NEW(string);
-						string_format(errorMessage, "%sILLEGAL SYMBOL DEFINITION %s%s%s ON LINE %s%i%s\n", LIGHT_RED, LIGHT_CYAN, parsed->symbol->c_str, LIGHT_RED, LIGHT_CYAN, line, NEWLINE);
-						vector_push_back(errors, (object*)errorMessage);
-					}else if (hashTable_has(programData->symtab, parsed->symbol->c_str))
-					{
-						bucket* dupe = hashTable_get(programData->symtab, parsed->symbol->c_str);
-						vector_push_back( /* ugly */
-							errors, (object*)string_make_and_format(
-							"%sDUPLICATE SYMBOL %s%s%s DETECTED ON LINE %s%i%s, DEFINED ON LINE %s%i%s!%s",
-							LIGHT_RED, LIGHT_CYAN, parsed->symbol->c_str, LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, LIGHT_CYAN, dupe->second->first, LIGHT_RED, NEWLINE
-						));
-						DELETE(dupe);
-					}
-					else {
-						pair* data = NEW(pair);
-						pair_make(data, line, programData->end); //line, address
-						hashTable_insert(programData->symtab, parsed->symbol->c_str, data);
-						DELETE(data);
-					};
-					if (errors->num == 0) /* no point in adding to this symbol table, we already have a fatal error. */
-						vector_push_back(symbols, (object*)string_make_and_format("│ %s%-8s%s│ %s%04lX %s│%s", YELLOW, parsed->symbol->c_str, RESET, LIGHT_CYAN, programData->end, RESET, NEWLINE));
-				}
-				if (parsed->opcode->length != 0)
-				{
-					vector_push_back(programData->instructions, (object*)parsed);
-					if (isOPCode(parsed->opcode, nullptr))
-					{
-						programData->end += 3; //initial increase...
-					}
-					else if (isDirective(parsed->opcode))
-					{
-						if (strcmp(parsed->opcode->c_str, "START") == 0)
-						{
-							if (totalInstructions > 1)
-								vector_push_back(errors, 
-									(object*)string_make_and_format(
-										"%sINVALID DIRECTIVE ON LINE %s%i%s, %sSTART%s IS ONLY VALID AS THE FIRST INSTRUCTION%s", 
-										LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, LIGHT_CYAN, LIGHT_RED, NEWLINE));
-							break;
-						}
-						else if (strcmp(parsed->opcode->c_str, "WORD") == 0)
-						{
-							long parsedValue = 0;
-							if (!fromDecimal(parsed->operand->c_str, &parsedValue) || parsedValue >= 0xFFFFFF || parsedValue < -0xFFFFFF)
-							{
-								vector_push_back(errors, (object*)string_make_and_format(
-									"%sINVALID VALUE %s%s%s ON LINE %s%i%s FOR DIRECTIVE %sWORD%s!%s",
-									LIGHT_RED, LIGHT_CYAN, parsed->operand->c_str, LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, LIGHT_CYAN, LIGHT_RED, NEWLINE));
-							}
-							else
-							{
-																		 //upper bit is set!
-								if (parsedValue > 0 && (parsedValue & 0x800000) == 0x800000)
-								{
-									vector_push_back(programData->warnings, (object*)string_make_and_format(
-										"%sPOSSIBLE OVERFLOW ON LINE %s%i%s %s%i%s > %s%i%s FOR DIRECTIVE %sWORD%s!%s",
-										YELLOW, LIGHT_CYAN, line, YELLOW, LIGHT_CYAN, parsedValue, YELLOW, LIGHT_CYAN, 0x7FFFFF, YELLOW, LIGHT_CYAN, YELLOW, NEWLINE));
-								}
-								programData->end += 3;
-							}
-						}
-						else if (strcmp(parsed->opcode->c_str, "END") == 0)
-						{
-							explicitEnd = true;
-						}
-						else if (strcmp(parsed->opcode->c_str, "RESW") == 0)
-						{
-							long parsedValue = 0;
-							if (!fromDecimal(parsed->operand->c_str, &parsedValue))
-							{
-								vector_push_back(errors, (object*)string_make_and_format(
-									"%sINVALID VALUE %s%s%s ON LINE %s%i%s FOR DIRECTIVE %sRESW%s!%s",
-									LIGHT_RED, LIGHT_CYAN, parsed->operand->c_str, LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, LIGHT_CYAN, LIGHT_RED, NEWLINE));
-							}
-							else
-							{
-								programData->end += 3 * parsedValue;
-							}
-						}
-						else if (strcmp(parsed->opcode->c_str, "RESB") == 0)
-						{
-							long parsedValue = 0;
-							if (!fromDecimal(parsed->operand->c_str, &parsedValue) || parsedValue < 1)
-							{
-								vector_push_back(errors, (object*)string_make_and_format(
-									"%sINVALID VALUE %s%s%s ON LINE %s%i%s FOR DIRECTIVE %sRESB%s!%s",
-									LIGHT_RED, LIGHT_CYAN, parsed->operand->c_str, LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, LIGHT_CYAN, LIGHT_RED, NEWLINE));
-							}
-							else
-							{
-								programData->end += parsedValue;
-							}
-						}
-						else if (strcmp(parsed->opcode->c_str, "BYTE") == 0)
-						{
-							if (parsed->operand->length == 0)
-							{
-								vector_push_back(errors, (object*)string_make_and_format(
-									"%sMISSING OPERAND ON LINE %s%i%s FOR DIRECTIVE %sBYTE%s!%s",
-									LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, LIGHT_CYAN, LIGHT_RED, NEWLINE));
-								break;
-							}
-
-							vector* op = NEW(vector);
-							string_split(parsed->operand, op, "'"); //there will be an extra blank string at the end. -> C'a' -> a ' b ' c -> C,a,
-
-							/* quick check if C/X */
-							if (op->num < 3 || (strcmp(((string*)op->data[0])->c_str, "C") != 0 && strcmp(((string*)op->data[0])->c_str, "X") != 0))
-							{
-								vector_push_back(errors, (object*)string_make_and_format(
-									"%sINVALID OPERAND %s%s%s ON LINE %s%i%s FOR DIRECTIVE %sBYTE%s!%s",
-									LIGHT_RED, LIGHT_CYAN, removeWhitespace(parsed->operand)->c_str, LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, LIGHT_CYAN, LIGHT_RED, NEWLINE));
-								DELETE(op);
-								break;
-							}
-							string* opType = (string*)op->data[0];
-							string* opData = (string*)op->data[1];
-							if (strcmp(opType->c_str, "C") == 0)
-							{
-								programData->end += strlen(opData->c_str); //check the chars maybe ? idk
-							}
-							else { /* (strcmp(opType->c_str, "X") == 0) */ //This MUST be X
-								int length = strlen(opData->c_str);
-								unsigned long parsedValue = 0;
-								if (!fromHex(opData->c_str, &parsedValue))
-								{
-									vector_push_back(errors, (object*)string_make_and_format(
-										"%sINVALID HEX VALUE %s%s%s ON LINE %s%i%s FOR DIRECTIVE %sBYTE%s!%s",
-										LIGHT_RED, LIGHT_CYAN, opData->c_str, LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, LIGHT_CYAN, LIGHT_RED, NEWLINE));
-								}
-								else
-								{
-									if ((length / 2) + (length % 2) != (length / 2))
-									{
-										vector_push_back(programData->warnings, (object*)string_make_and_format(
-											"%sIMPLICIT LEADING ZERO ON LINE %s%i%s, %s%s%s DID YOU MEAN %s0%s%s?%s",
-											YELLOW, LIGHT_CYAN, line, YELLOW, LIGHT_CYAN, opData->c_str, YELLOW, LIGHT_CYAN, opData->c_str, YELLOW, NEWLINE));
-									}
-									programData->end += (length / 2) + (length % 2); //round-up to nearest multiple of 2. FFF -> 0F FF NOT FF!!
-								}
-							}
-							DELETE(op);
-						}
-						else {
-							programData->end += 3;
-						}
-					}
-					else
-					{
-						vector_push_back(errors, (object*)string_make_and_format(
-							"%sILLEGAL INSTRUCTION %s%s%s ON LINE %s%i%s!%s",
-							LIGHT_RED, LIGHT_CYAN, parsed->opcode->c_str, LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, NEWLINE));
-					}
-				}
-				else {
-				vector_push_back(errors, (object*)string_make_and_format(
-					"%sMISSING INSTRUCTION ON LINE %s%i%s!%s",
-					LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, NEWLINE));
-				}
-				break;
+#if SCAN_X86
+static void hexEncode_sse2(const unsigned char* bytes, unsigned int length, char* out)
+{
+	const __m128i nibble = _mm_set1_epi8(0x0F), nine = _mm_set1_epi8(9), zero = _mm_set1_epi8('0'), gap = _mm_set1_epi8('A' - '0' - 10);
+	unsigned int i = 0;
+	for (; i + 16 <= length; i += 16)
+	{
+		__m128i block = _mm_loadu_si128((const __m128i*)(bytes + i));
+		__m128i high = _mm_and_si128(_mm_srli_epi16(block, 4), nibble);
+		__m128i low = _mm_and_si128(block, nibble);
+		__m128i first = _mm_unpacklo_epi8(high, low);
+		__m128i second = _mm_unpackhi_epi8(high, low);
+		first = _mm_add_epi8(_mm_add_epi8(first, zero), _mm_and_si128(_mm_cmpgt_epi8(first, nine), gap));
+		second = _mm_add_epi8(_mm_add_epi8(second, zero), _mm_and_si128(_mm_cmpgt_epi8(second, nine), gap));
+		_mm_storeu_si128((__m128i*)(out + 2 * i), first);
+		_mm_storeu_si128((__m128i*)(out + 2 * i + 16), second);
+	}
+	hexEncode_swar(bytes + i, length - i, out + 2 * i);
+}
+#endif
+
+static const struct { const char* name; hexKernel kernel; } hexKernels[] = {
+	{ "scalar", hexEncode_scalar },
+	{ "swar", hexEncode_swar },
+#if SCAN_X86
+	{ "sse2", hexEncode_sse2 },
+#endif
+};
+
+/* 2 * length uppercase hex digits of bytes into out, not NUL terminated. */
+void hexEncode(const unsigned char* bytes, unsigned int length, char* out)
+{
+	hexKernels[sizeof(hexKernels) / sizeof(hexKernels[0]) - 1].kernel(bytes, length, out);
+}
+
+/* 0x80 in every byte of x that is in [lo, hi], the bytes must all be below 0x80. */
+static unsigned long long swarInRange(unsigned long long x, unsigned char lo, unsigned char hi)
+{
+	const unsigned long long ones = 0x0101010101010101ULL;
+	return (x + ones * (0x80 - lo)) & ~(x + ones * (0x7F - hi)) & ones * 0x80;
+}
+
+/* up to 8 characters right aligned in a word padded with '0', the first character in the lowest byte. */
+static unsigned long long swarLoad(const char* text, unsigned int length)
+{
+	char buffer[8] = { '0', '0', '0', '0', '0', '0', '0', '0' };
+	memcpy(buffer + 8 - length, text, length);
+	unsigned long long word;
+	memcpy(&word, buffer, 8);
+	return word;
+}
+
+bool parseHex(slice who, unsigned long* value)
+{
+	const unsigned long long high = 0x8080808080808080ULL;
+	if (who.length == 0 || who.length > 8 || !littleEndian())
+		return false;
+	unsigned long long word = swarLoad(who.text, who.length);
+	if (word & high)
+		return false;
+	unsigned long long letters = swarInRange(word, 'A', 'F') | swarInRange(word, 'a', 'f');
+	if ((swarInRange(word, '0', '9') | letters) != high)
+		return false;
+	unsigned long long nibbles = (word & 0x0F0F0F0F0F0F0F0FULL) + (letters >> 7) * 9;
+	nibbles = ((nibbles & 0x000F000F000F000FULL) << 4) | ((nibbles >> 8) & 0x000F000F000F000FULL); /* digit pairs, first one high */
+	*value = (unsigned long)(((nibbles & 0xFF) << 24) | (((nibbles >> 16) & 0xFF) << 16) | (((nibbles >> 32) & 0xFF) << 8) | ((nibbles >> 48) & 0xFF));
+	return true;
+}
+
+bool parseDecimal(slice who, long* value)
+{
+	const unsigned long long high = 0x8080808080808080ULL;
+	bool sign = who.length != 0 && (who.text[0] == '-' || who.text[0] == '+');
+	slice digits = { who.text + sign, who.length - sign };
+	if (digits.length == 0 || digits.length > 8 || !littleEndian())
+		return false;
+	unsigned long long word = swarLoad(digits.text, digits.length);
+	if ((word & high) || swarInRange(word, '0', '9') != high)
+		return false;
+	word -= 0x3030303030303030ULL;
+	word = word * 10 + (word >> 8); /* pairs */
+	word = ((word & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32)) + ((word >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32))) >> 32;
+	*value = sign && who.text[0] == '-' ? -(long)(unsigned int)word : (long)(unsigned int)word;
+	return true;
+}
+#pragma endregion
+
+#pragma region pass one
+
+typedef enum mnemonicKind { MNEMONIC_NONE, MNEMONIC_OPCODE, MNEMONIC_DIRECTIVE } mnemonicKind;
+typedef struct mnemonic { mnemonicKind kind; unsigned int value; } mnemonic; //value = opcode for MNEMONIC_OPCODE, directiveType for MNEMONIC_DIRECTIVE.
+
+unsigned long long packMnemonic(const char* who, unsigned int length)
+{
+	if (length > 8)
+		return 0; /* longer than any mnemonic */
+	unsigned long long key = 0;
+	for (unsigned int i = 0; i < length; ++i)
+		key = (key << 8) | (unsigned char)who[i];
+	return key;
+}
+
+/* one packed-integer switch over SIC_INSTRUCTIONS and SIC_DIRECTIVES instead of strcmp scans. */
+mnemonic classifyMnemonic(const char* who, unsigned int length)
+{
+	mnemonic result = { MNEMONIC_NONE, 0 };
+	switch (packMnemonic(who, length))
+	{
+#define AS_OPCODE_CASE(NAME, VALUE, KEY) case KEY: result.kind = MNEMONIC_OPCODE; result.value = VALUE; break;
+#define AS_DIRECTIVE_CASE(NAME, VALUE, KEY) case KEY: result.kind = MNEMONIC_DIRECTIVE; result.value = VALUE; break;
+	SIC_INSTRUCTIONS(AS_OPCODE_CASE)
+	SIC_DIRECTIVES(AS_DIRECTIVE_CASE)
+#undef AS_OPCODE_CASE
+#undef AS_DIRECTIVE_CASE
+	}
+	return result;
+}
+
+unsigned int mnemonicId(mnemonic what)
+{
+	if (what.kind == MNEMONIC_DIRECTIVE)
+		return what.value;
+	return what.kind == MNEMONIC_OPCODE ? INSTRUCTION_OPCODE : INSTRUCTION_UNKNOWN;
+}
+
+/*
+* lexToken runs one small DFA per token kind in lockstep over the bytes of a slice, each a [state][charClass] table in which
+* state 0 is dead, and stops once every one of them is. The rules are the ones the assembler always had:
+* a symbol is 1 to 6 characters, starts with A-Z, has none of the CC_BLANK/CC_PLUS/CC_MINUS/CC_INVALID characters and isn't a directive.
+* Numbers follow strtoul (hex) and strtol (decimal): leading whitespace, an optional sign, for hex an optional 0x once a digit
+* follows, at least one digit and nothing after. Values are strtoul / strtol's too, also the partial one of an invalid number,
+* saturated on overflow. A NUL would end a C string early, slices from the source never hold one.
+* A C'..' or X'..' literal is the prefix, a quote and a payload up to the next quote, whatever follows that is ignored.
+* A comment starts with '#'. Several kinds can apply at once, "C'A'" is both a literal and a symbol.
+*/
+typedef enum lexKind { LEX_SYMBOL = 1, LEX_HEX = 2, LEX_DECIMAL = 4, LEX_CHARS = 8, LEX_BYTES = 16, LEX_COMMENT = 32 } lexKind;
+typedef struct lexeme {
+	unsigned int kinds; //lexKind bits
+	unsigned long hex; long decimal; //the values strtoul / strtol would give
+	slice payload; //between the quotes of a C or X literal
+} lexeme;
+
+/* class groups for the tables below, CC_PLAIN is every class but the quote and the four no symbol can contain. */
+#define CC_LETTERS(NEXT) [CC_HEX_UPPER] = NEXT, [CC_C] = NEXT, [CC_X] = NEXT, [CC_UPPER] = NEXT
+#define CC_HEX_DIGITS(NEXT) [CC_DIGIT] = NEXT, [CC_HEX_UPPER] = NEXT, [CC_HEX_LOWER] = NEXT, [CC_C] = NEXT
+#define CC_NOT_SYMBOL(NEXT) [CC_BLANK] = NEXT, [CC_PLUS] = NEXT, [CC_MINUS] = NEXT, [CC_INVALID] = NEXT
+#define CC_PLAIN(NEXT) CC_LETTERS(NEXT), [CC_OTHER] = NEXT, [CC_SPACE] = NEXT, [CC_ZERO] = NEXT, [CC_DIGIT] = NEXT, \
+	[CC_HEX_LOWER] = NEXT, [CC_SMALL_X] = NEXT, [CC_HASH] = NEXT
+
+enum { NUM_DEAD, NUM_START, NUM_SIGN, NUM_ZERO, NUM_PREFIX, NUM_DIGITS, NUM_STATES };
+static const unsigned char hexStates[NUM_STATES][CC_COUNT] = {
+	[NUM_START] = { [CC_BLANK] = NUM_START, [CC_SPACE] = NUM_START, [CC_PLUS] = NUM_SIGN, [CC_MINUS] = NUM_SIGN, [CC_ZERO] = NUM_ZERO, CC_HEX_DIGITS(NUM_DIGITS) },
+	[NUM_SIGN] = { [CC_ZERO] = NUM_ZERO, CC_HEX_DIGITS(NUM_DIGITS) },
+	[NUM_ZERO] = { [CC_X] = NUM_PREFIX, [CC_SMALL_X] = NUM_PREFIX, [CC_ZERO] = NUM_DIGITS, CC_HEX_DIGITS(NUM_DIGITS) },
+	[NUM_PREFIX] = { [CC_ZERO] = NUM_DIGITS, CC_HEX_DIGITS(NUM_DIGITS) },
+	[NUM_DIGITS] = { [CC_ZERO] = NUM_DIGITS, CC_HEX_DIGITS(NUM_DIGITS) }
+};
+static const unsigned char decimalStates[NUM_STATES][CC_COUNT] = {
+	[NUM_START] = { [CC_BLANK] = NUM_START, [CC_SPACE] = NUM_START, [CC_PLUS] = NUM_SIGN, [CC_MINUS] = NUM_SIGN, [CC_ZERO] = NUM_DIGITS, [CC_DIGIT] = NUM_DIGITS },
+	[NUM_SIGN] = { [CC_ZERO] = NUM_DIGITS, [CC_DIGIT] = NUM_DIGITS },
+	[NUM_DIGITS] = { [CC_ZERO] = NUM_DIGITS, [CC_DIGIT] = NUM_DIGITS }
+};
+
+enum { SYM_DEAD, SYM_START, SYM_BODY, SYM_STATES };
+static const unsigned char symbolStates[SYM_STATES][CC_COUNT] = {
+	[SYM_START] = { CC_LETTERS(SYM_BODY) },
+	[SYM_BODY] = { CC_PLAIN(SYM_BODY), [CC_QUOTE] = SYM_BODY }
+};
+
+enum { LIT_DEAD, LIT_START, LIT_C, LIT_X, LIT_CHARS, LIT_BYTES, LIT_CHARS_END, LIT_BYTES_END, LIT_STATES };
+static const unsigned char literalStates[LIT_STATES][CC_COUNT] = {
+	[LIT_START] = { [CC_C] = LIT_C, [CC_X] = LIT_X },
+	[LIT_C] = { [CC_QUOTE] = LIT_CHARS },
+	[LIT_X] = { [CC_QUOTE] = LIT_BYTES },
+	[LIT_CHARS] = { CC_PLAIN(LIT_CHARS), CC_NOT_SYMBOL(LIT_CHARS), [CC_QUOTE] = LIT_CHARS_END },
+	[LIT_BYTES] = { CC_PLAIN(LIT_BYTES), CC_NOT_SYMBOL(LIT_BYTES), [CC_QUOTE] = LIT_BYTES_END },
+	[LIT_CHARS_END] = { CC_PLAIN(LIT_CHARS_END), CC_NOT_SYMBOL(LIT_CHARS_END), [CC_QUOTE] = LIT_CHARS_END },
+	[LIT_BYTES_END] = { CC_PLAIN(LIT_BYTES_END), CC_NOT_SYMBOL(LIT_BYTES_END), [CC_QUOTE] = LIT_BYTES_END }
+};
+static const unsigned char literalPayload[LIT_STATES] = { [LIT_CHARS] = 1, [LIT_BYTES] = 1 }; //the opening quote counts too
+
+#undef CC_LETTERS
+#undef CC_HEX_DIGITS
+#undef CC_NOT_SYMBOL
+#undef CC_PLAIN
+
+unsigned int lexToken(slice who, lexeme* out)
+{
+	unsigned int hex = NUM_START, decimal = NUM_START, literal = LIT_START;
+	unsigned int symbol = who.length - 1 < 6 ? SYM_START : SYM_DEAD; /* 0 wraps around */
+	unsigned long hexValue = 0, decimalValue = 0, payload = 0;
+	bool hexNegative = false, decimalNegative = false, hexOverflow = false, decimalOverflow = false;
+	for (unsigned int i = 0; i < who.length && (hex | decimal | symbol | literal) != NUM_DEAD; ++i)
+	{
+		unsigned char c = (unsigned char)who.text[i];
+		unsigned int type = charClasses[c];
+		hexNegative |= hex == NUM_START && type == CC_MINUS;
+		decimalNegative |= decimal == NUM_START && type == CC_MINUS;
+		hex = hexStates[hex][type];
+		decimal = decimalStates[decimal][type];
+		symbol = symbolStates[symbol][type];
+		literal = literalStates[literal][type];
+		payload += literalPayload[literal];
+		if (hex == NUM_DIGITS)
+		{
+			hexOverflow |= hexValue > ULONG_MAX >> 4;
+			hexValue = hexValue << 4 | digitValues[c];
+		}
+		if (decimal == NUM_DIGITS)
+		{
+			decimalOverflow |= decimalValue > (ULONG_MAX - digitValues[c]) / 10;
+			decimalValue = decimalValue * 10 + digitValues[c];
+		}
+	}
+
+	unsigned long magnitude = decimalNegative ? (unsigned long)LONG_MAX + 1 : (unsigned long)LONG_MAX;
+	out->hex = hexOverflow ? ULONG_MAX : hexNegative ? 0 - hexValue : hexValue;
+	if (decimalOverflow || decimalValue > magnitude)
+		out->decimal = decimalNegative ? LONG_MIN : LONG_MAX;
+	else
+		out->decimal = decimalNegative ? (long)(0 - decimalValue) : (long)decimalValue;
+	out->payload.text = who.text + (who.length < 2 ? who.length : 2);
+	out->payload.length = payload != 0 ? (unsigned int)payload - 1 : 0;
+
+	unsigned int kinds = 0;
+	if (hex == NUM_ZERO || hex == NUM_DIGITS)
+		kinds |= LEX_HEX;
+	if (decimal == NUM_DIGITS)
+		kinds |= LEX_DECIMAL;
+	if (literal == LIT_CHARS_END)
+		kinds |= LEX_CHARS;
+	else if (literal == LIT_BYTES_END)
+		kinds |= LEX_BYTES;
+	if (who.length != 0 && charClasses[(unsigned char)who.text[0]] == CC_HASH)
+		kinds |= LEX_COMMENT;
+	if (symbol == SYM_BODY && classifyMnemonic(who.text, who.length).kind != MNEMONIC_DIRECTIVE)
+		kinds |= LEX_SYMBOL;
+	out->kinds = kinds;
+	return kinds;
+}
+
+bool isSymbolText(const char* who, unsigned int length)
+{
+	if (!VALID(who))
+		return false;
+	lexeme token;
+	slice text = { who, length };
+	return (lexToken(text, &token) & LEX_SYMBOL) != 0;
+}
+
+bool sliceFromHex(slice who, unsigned long* val)
+{
+	if (parseHex(who, val))
+		return true;
+	lexeme token;
+	lexToken(who, &token);
+	*val = token.hex;
+	return (token.kinds & LEX_HEX) != 0;
+}
+
+bool sliceFromDecimal(slice who, long* val)
+{
+	if (parseDecimal(who, val))
+		return true;
+	lexeme token;
+	lexToken(who, &token);
+	*val = token.decimal;
+	return (token.kinds & LEX_DECIMAL) != 0;
+}
+
+/* fills the operandBase and index fields from tokens->operand. flags (see lineMap) say whether to look for a comma at all. */
+void splitOperand(lineTokens* tokens, unsigned int flags)
+{
+	slice operand = tokens->operand;
+	const char* end = operand.text + operand.length;
+
+	const char* comma = flags & LINEMAP_COMMAS ? memchr(operand.text, ',', operand.length) : NULL;
+	tokens->operandBase = operand;
+	tokens->indexed = tokens->badIndex = false;
+	if (VALID(comma))
+	{
+		tokens->operandBase.length = (unsigned int)(comma - operand.text);
+		slice index = { comma + 1, (unsigned int)(end - comma - 1) };
+		if (!VALID(memchr(index.text, ',', index.length))) /* exactly two fields, anything more is left alone */
+		{
+			tokens->indexed = sliceIs(index, "X");
+			tokens->badIndex = !tokens->indexed;
+		}
+	}
+}
+
+/*
+* Cuts one line (not NUL terminated) into tokens in a single left to right scan, no copies. Same rules the old split had:
+* the line and every column lose their trailing whitespace, columns are tab separated (label, mnemonic, operand, comment),
+* missing columns are empty and anything after a fourth tab is ignored. A line starting with '#' is a comment.
+* With the line's map from the scan (may be NULL) the tabs, comment marker and commas are already known.
+*/
+lineKind tokenizeLine(const char* text, unsigned int length, const lineMap* map, lineTokens* tokens)
+{
+	length = trimmedLength(text, length);
+	slice empty = { text, 0 };
+	tokens->label = tokens->mnemonic = tokens->operand = tokens->comment = empty;
+	if (length == 0)
+		return LINE_BLANK;
+	if (VALID(map) && (map->flags & LINEMAP_LONG))
+		map = NULL;
+	if (VALID(map) ? (map->flags & LINEMAP_COMMENT) != 0 : text[0] == '#')
+		return LINE_COMMENT;
+
+	slice* columns[] = { &tokens->label, &tokens->mnemonic, &tokens->operand, &tokens->comment };
+	const char* cursor = text;
+	const char* end = text + length;
+	for (unsigned int column = 0; column < 4; ++column)
+	{
+		const char* tab = NULL; /* trailing whitespace never holds a tab, so mapped tabs are all before end */
+		if (VALID(map) && column < 3)
+			tab = map->tabs[column] != 0 ? text + map->tabs[column] - 1 : NULL;
+		else
+			tab = memchr(cursor, '\t', end - cursor);
+		const char* stop = VALID(tab) ? tab : end;
+		columns[column]->text = cursor;
+		columns[column]->length = trimmedLength(cursor, (unsigned int)(stop - cursor));
+		if (!VALID(tab))
+			break;
+		cursor = tab + 1;
+	}
+	splitOperand(tokens, VALID(map) ? map->flags : LINEMAP_COMMAS);
+	return LINE_INSTRUCTION;
+}
+
+/* decodes the operand of a tokenized instruction with the given instructionId, returns its operandKind and flags. */
+unsigned char decodeOperand(const lineTokens* tokens, unsigned int id, unsigned long long* value)
+{
+	lexeme token;
+	*value = 0;
+	switch (id)
+	{
+	case INSTRUCTION_OPCODE:
+	case DIRECTIVE_END:
+	{
+		slice base = tokens->operandBase;
+		unsigned char flags = (tokens->indexed ? OPERAND_INDEXED : 0) | (tokens->badIndex ? OPERAND_BAD_INDEX : 0);
+		unsigned int kinds = lexToken(base, &token);
+		if (kinds & LEX_SYMBOL)
+		{
+			*value = symbolTable_pack(base.text, base.length);
+			return OPERAND_SYMBOL | flags;
+		}
+		if (base.length == 0)
+			return OPERAND_NONE | flags;
+		*value = token.hex;
+		return ((kinds & LEX_HEX) ? OPERAND_NUMBER : OPERAND_INVALID) | flags;
+	}
+	case DIRECTIVE_WORD:
+	case DIRECTIVE_RESB:
+	case DIRECTIVE_RESW:
+	{
+		long decimal = 0;
+		sliceFromDecimal(tokens->operand, &decimal);
+		*value = (unsigned long long)decimal;
+		return OPERAND_NUMBER;
+	}
+	case DIRECTIVE_BYTE:
+	{
+		unsigned int kinds = lexToken(tokens->operand, &token);
+		*value = token.payload.length;
+		return (kinds & LEX_CHARS) ? OPERAND_CHARS : (kinds & LEX_BYTES) ? OPERAND_BYTES : OPERAND_NONE;
+	}
+	}
+	return OPERAND_NONE;
+}
+
+#pragma endregion
+
+#pragma endregion
+
+typedef struct program {
+	unsigned long start;
+	unsigned long end;
+	unsigned long firstInstruction;
+	string* name;
+	symbolTable* symtab;
+	instructionStore* instructions;
+	vector* warnings;
+	internPool* names;
+	bool streaming; //pass 2 rescans the source instead of reading programData->instructions.
+} program;
+
+/* resolves a decoded operand ("SYMBOL", "hex", "" or either followed by ",X"). */
+bool operandToValue(unsigned char operand, unsigned long long decoded, program* programData, unsigned long* value)
+{
+	switch (operand & OPERAND_KIND_MASK)
+	{
+	case OPERAND_SYMBOL:
+	{
+		symbol* entry = symbolTable_lookup(programData->symtab, decoded);
+		if (!VALID(entry))
+			return false;
+		*value = entry->address;
+		break;
+	}
+	case OPERAND_NUMBER:
+		*value = (unsigned long)decoded;
+		break;
+	case OPERAND_INVALID:
+		*value = (unsigned long)decoded;
+		return false;
+	default:
+		*value = 0;
+		break;
+	}
+
+	if (operand & OPERAND_BAD_INDEX)
+		return false;
+	if (operand & OPERAND_INDEXED)
+		*value |= 0x8000; //set upper 8th bit for indexed mode
+	return true;
+}
+
+void printWarnings(vector* warnings)
+{
+	report("\n %s%i%s WARNINGS DETECTED%s", LIGHT_CYAN, warnings->num, YELLOW, NEWLINE);
+
+	report("┌────────────────────────┐\n");
+	report("│ \33[7m%sWARRNING SUMMARY BELOW\33[27m%s │%s", YELLOW, RESET, NEWLINE);
+	report("└────────────────────────┘\n");
+
+	for (unsigned int i = 0; i < warnings->num; ++i)
+	{
+		string* warning = (string*)warnings->data[i];
+		report(" %s%u.%s %s", LIGHT_CYAN, i + 1, RESET, warning->c_str);
+	}
+}
+
+unsigned int minimum(unsigned int A, unsigned int B)
+{
+	return A < B ? A : B; //returns the smaller of 2 ints.
+}
+
+unsigned int maximum(unsigned int A, unsigned int B)
+{
+	return A > B ? A : B; //returns the larger of 2 ints.
+}
+
+/*
+* Worker threads. workers_run calls body once for each of count arguments (an array, size bytes apart): the first on the calling
+* thread, every other on a thread of its own (or on the calling thread too when no thread can be started), and returns once they
+* are all done. The bodies share nothing but what their arguments point at, diagnostics included.
+*/
+#ifndef MAX_WORKERS
+#define MAX_WORKERS 64
+#endif
+typedef void (*workerBody)(void* argument);
+#if defined(_WIN32)
+typedef HANDLE workerThread;
+#else
+typedef pthread_t workerThread;
+#endif
+typedef struct worker { workerBody body; void* argument; bool started; workerThread thread; } worker;
+
+#if defined(_WIN32)
+static DWORD WINAPI worker_entry(LPVOID who)
+{
+	worker* self = who;
+	self->body(self->argument);
+	return 0;
+}
+#else
+static void* worker_entry(void* who)
+{
+	worker* self = who;
+	self->body(self->argument);
+	return NULL;
+}
+#endif
+
+void workers_run(worker* workers, unsigned int count, workerBody body, void* arguments, unsigned long size)
+{
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		worker* self = &workers[i];
+		self->body = body;
+		self->argument = (char*)arguments + i * size;
+#if defined(_WIN32)
+		self->thread = i == 0 ? NULL : CreateThread(NULL, 0, worker_entry, self, 0, NULL);
+		self->started = self->thread != NULL;
+#else
+		self->started = i != 0 && pthread_create(&self->thread, NULL, worker_entry, self) == 0;
+#endif
+	}
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		worker* self = &workers[i];
+		if (!self->started)
+		{
+			body(self->argument); /* no thread to be had, run it here */
+			continue;
+		}
+#if defined(_WIN32)
+		WaitForSingleObject(self->thread, INFINITE);
+		CloseHandle(self->thread);
+#else
+		pthread_join(self->thread, NULL);
+#endif
+	}
+}
+
+unsigned int processorCount()
+{
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (unsigned int)info.dwNumberOfProcessors;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (unsigned int)count : 1;
+#endif
+}
+
+/*
+* Pass 1 takes every line in two steps. pass1_measure looks at the line on its own: its mnemonic, how far it moves the location
+* counter and what is wrong with it, none of which depends on the lines before it. pass1_place does everything that does: END,
+* the location counter and its limit, START and the symbol table, then reports what was measured. The serial loop alternates the
+* two, pass1_parallel measures a batch of lines on several threads and then places them in order (adding up the sizes as it goes),
+* so both give the same program and the same diagnostics in the same order.
+*/
+typedef enum lineProblem {
+	PROBLEM_NONE, PROBLEM_WORD_VALUE, PROBLEM_WORD_OVERFLOW, PROBLEM_RESW_VALUE, PROBLEM_RESB_VALUE, PROBLEM_BYTE_MISSING,
+	PROBLEM_BYTE_OPERAND, PROBLEM_BYTE_HEX, PROBLEM_BYTE_LEADING_ZERO, PROBLEM_ILLEGAL, PROBLEM_MISSING
+} lineProblem; //at most one per line, PROBLEM_WORD_OVERFLOW and PROBLEM_BYTE_LEADING_ZERO are warnings.
+
+typedef struct lineMeasure {
+	mnemonic what; unsigned int id;
+	long size; //added to the location counter
+	unsigned char problem;
+	long value; slice payload; //WORD's value and an X literal's payload, for the messages
+	bool decoded; unsigned char operand; unsigned long long operandValue; //decodeOperand done ahead, otherwise pass1_place does it
+} lineMeasure;
+
+static void pass1_measure(const lineTokens* tokens, lineMeasure* measure)
+{
+	mnemonic what = classifyMnemonic(tokens->mnemonic.text, tokens->mnemonic.length);
+	measure->what = what;
+	measure->size = 0;
+	measure->problem = PROBLEM_NONE;
+	measure->decoded = false;
+	slice operand = tokens->operand;
+	measure->id = mnemonicId(what);
+	if (tokens->mnemonic.length == 0)
+		measure->problem = PROBLEM_MISSING;
+	else if (what.kind == MNEMONIC_OPCODE)
+		measure->size = 3;
+	else if (what.kind != MNEMONIC_DIRECTIVE)
+		measure->problem = PROBLEM_ILLEGAL;
+	else switch (what.value)
+	{
+	case DIRECTIVE_START:
+	case DIRECTIVE_END: /* all in pass1_place */
+		break;
+	case DIRECTIVE_WORD:
+		if (!sliceFromDecimal(operand, &measure->value) || measure->value >= 0xFFFFFF || measure->value < -0xFFFFFF)
+			measure->problem = PROBLEM_WORD_VALUE;
+		else {
+			if (measure->value > 0 && (measure->value & 0x800000) == 0x800000) //upper bit is set!
+				measure->problem = PROBLEM_WORD_OVERFLOW;
+			measure->size = 3;
+		}
+		break;
+	case DIRECTIVE_RESW:
+		if (!sliceFromDecimal(operand, &measure->value))
+			measure->problem = PROBLEM_RESW_VALUE;
+		else
+			measure->size = 3 * measure->value;
+		break;
+	case DIRECTIVE_RESB:
+		if (!sliceFromDecimal(operand, &measure->value) || measure->value < 1)
+			measure->problem = PROBLEM_RESB_VALUE;
+		else
+			measure->size = measure->value;
+		break;
+	case DIRECTIVE_BYTE:
+	{
+		lexeme literal; //C'a' -> LEX_CHARS, payload a
+		if (operand.length == 0)
+			measure->problem = PROBLEM_BYTE_MISSING;
+		else if (!(lexToken(operand, &literal) & (LEX_CHARS | LEX_BYTES)))
+			measure->problem = PROBLEM_BYTE_OPERAND;
+		else if (literal.kinds & LEX_CHARS)
+			measure->size = literal.payload.length; //check the chars maybe ? idk
+		else { /* LEX_BYTES */
+			unsigned int length = literal.payload.length;
+			unsigned long parsedValue = 0;
+			measure->payload = literal.payload;
+			if (!sliceFromHex(literal.payload, &parsedValue))
+				measure->problem = PROBLEM_BYTE_HEX;
+			else {
+				if (length % 2 != 0)
+					measure->problem = PROBLEM_BYTE_LEADING_ZERO;
+				measure->size = (length / 2) + (length % 2); //round-up to nearest multiple of 2. FFF -> 0F FF NOT FF!!
 			}
-			//DELETE(parsed);
 		}
+		break;
+	}
+	default:
+		measure->size = 3;
+		break;
+	}
+}
+
+void pass1_report(const lineTokens* tokens, const lineMeasure* measure, unsigned int line, vector* errors, vector* warnings)
+{
+	slice operand = tokens->operand;
+	slice opData = measure->payload;
+	switch (measure->problem)
+	{
+	case PROBLEM_WORD_VALUE:
+		vector_push_back(errors, (object*)string_make_and_format(
+			"%sINVALID VALUE %s%.*s%s ON LINE %s%i%s FOR DIRECTIVE %sWORD%s!%s",
+			LIGHT_RED, LIGHT_CYAN, SLICE_ARGS(operand), LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, LIGHT_CYAN, LIGHT_RED, NEWLINE));
+		break;
+	case PROBLEM_WORD_OVERFLOW:
+		vector_push_back(warnings, (object*)string_make_and_format(
+			"%sPOSSIBLE OVERFLOW ON LINE %s%i%s %s%i%s > %s%i%s FOR DIRECTIVE %sWORD%s!%s",
+			YELLOW, LIGHT_CYAN, line, YELLOW, LIGHT_CYAN, measure->value, YELLOW, LIGHT_CYAN, 0x7FFFFF, YELLOW, LIGHT_CYAN, YELLOW, NEWLINE));
+		break;
+	case PROBLEM_RESW_VALUE:
+		vector_push_back(errors, (object*)string_make_and_format(
+			"%sINVALID VALUE %s%.*s%s ON LINE %s%i%s FOR DIRECTIVE %sRESW%s!%s",
+			LIGHT_RED, LIGHT_CYAN, SLICE_ARGS(operand), LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, LIGHT_CYAN, LIGHT_RED, NEWLINE));
+		break;
+	case PROBLEM_RESB_VALUE:
+		vector_push_back(errors, (object*)string_make_and_format(
+			"%sINVALID VALUE %s%.*s%s ON LINE %s%i%s FOR DIRECTIVE %sRESB%s!%s",
+			LIGHT_RED, LIGHT_CYAN, SLICE_ARGS(operand), LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, LIGHT_CYAN, LIGHT_RED, NEWLINE));
+		break;
+	case PROBLEM_BYTE_MISSING:
+		vector_push_back(errors, (object*)string_make_and_format(
+			"%sMISSING OPERAND ON LINE %s%i%s FOR DIRECTIVE %sBYTE%s!%s",
+			LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, LIGHT_CYAN, LIGHT_RED, NEWLINE));
+		break;
+	case PROBLEM_BYTE_OPERAND:
+		vector_push_back(errors, (object*)string_make_and_format(
+			"%sINVALID OPERAND %s%.*s%s ON LINE %s%i%s FOR DIRECTIVE %sBYTE%s!%s",
+			LIGHT_RED, LIGHT_CYAN, SLICE_ARGS(operand), LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, LIGHT_CYAN, LIGHT_RED, NEWLINE));
+		break;
+	case PROBLEM_BYTE_HEX:
+		vector_push_back(errors, (object*)string_make_and_format(
+			"%sINVALID HEX VALUE %s%.*s%s ON LINE %s%i%s FOR DIRECTIVE %sBYTE%s!%s",
+			LIGHT_RED, LIGHT_CYAN, SLICE_ARGS(opData), LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, LIGHT_CYAN, LIGHT_RED, NEWLINE));
+		break;
+	case PROBLEM_BYTE_LEADING_ZERO:
+		vector_push_back(warnings, (object*)string_make_and_format(
+			"%sIMPLICIT LEADING ZERO ON LINE %s%i%s, %s%.*s%s DID YOU MEAN %s0%.*s%s?%s",
+			YELLOW, LIGHT_CYAN, line, YELLOW, LIGHT_CYAN, SLICE_ARGS(opData), YELLOW, LIGHT_CYAN, SLICE_ARGS(opData), YELLOW, NEWLINE));
+		break;
+	case PROBLEM_ILLEGAL:
+		vector_push_back(errors, (object*)string_make_and_format(
+			"%sILLEGAL INSTRUCTION %s%.*s%s ON LINE %s%i%s!%s",
+			LIGHT_RED, LIGHT_CYAN, SLICE_ARGS(tokens->mnemonic), LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, NEWLINE));
+		break;
+	case PROBLEM_MISSING:
+		vector_push_back(errors, (object*)string_make_and_format(
+			"%sMISSING INSTRUCTION ON LINE %s%i%s!%s",
+			LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, NEWLINE));
+		break;
+	}
+}
+
+/* What pass 1 carries from one line to the next, besides programData. */
+typedef struct pass1State { vector* errors; bool explicitStart; bool addressExceeded; bool explicitEnd; unsigned int totalInstructions; } pass1State;
+
+/* measure is only read for a LINE_INSTRUCTION, last is set for the last line of the source. */
+static void pass1_place(pass1State* state, program* programData, lineKind kind, const lineTokens* tokens, lineMeasure* measure, unsigned int line, bool last)
+{
+	vector* errors = state->errors;
+	//why <= 1? whitepace on one of the test files. A proper solution would be to remove leading and trailing whitespace,,,, TODO!
+	if (kind == LINE_BLANK) //ignore last line potential whitespace.
+	{
+		if (!last)
+			vector_push_back(errors, (object*)string_make_and_format("%sLINE %s%i%s WAS EMPTY!%s", LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, NEWLINE));
+		return;
+	}
+	if (kind == LINE_COMMENT) //comment
+		return;
+	if (state->explicitEnd) /* program has ended! */
+	{
+		vector_push_back(programData->warnings, (object*)string_make_and_format("%sINSTRUCTION ON LINE %s%i%s IS AFTER %sEND%s AND IS IGNORED%s", YELLOW, LIGHT_CYAN, line, YELLOW, LIGHT_CYAN, YELLOW, NEWLINE));
+		return;
+	}
+	if (!state->addressExceeded && programData->end >= 0x8000)
+	{
+		state->addressExceeded = true;
+		vector_push_back(errors, (object*)string_make_and_format("%sMAXIMUM ADDRESSABLE MEMORY EXCEEDED %s%X%s >= %s%X%s BY LINE %s%i%s!%s",
+			LIGHT_RED, LIGHT_CYAN, programData->end, LIGHT_RED, LIGHT_CYAN, 0x8000, LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, NEWLINE));
+	}
+	slice label = tokens->label;
+	slice operand = tokens->operand;
+	mnemonic what = measure->what;
+	if (programData->firstInstruction == (long unsigned int) -1 && what.kind == MNEMONIC_OPCODE)
+		programData->firstInstruction = programData->end;
+	if (++state->totalInstructions == 1 && measure->id == DIRECTIVE_START)
+	{
+		if (operand.length == 0)
+			vector_push_back(errors, (object*)string_make_and_format("%sLINE %s%i%s MISSING OPERAND!%s", LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, NEWLINE));
+		else if (operand.text[0] == '-')
+			vector_push_back(errors, (object*)string_make_and_format("%sLINE %s%i%s CONTAINS INVALID HEXADECIMAL %s%.*s%s < %s0%s%s",
+				LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, LIGHT_CYAN, SLICE_ARGS(operand), LIGHT_RED, LIGHT_CYAN, LIGHT_RED, NEWLINE));
+		else if (!sliceFromHex(operand, &programData->end))
+		{
+			vector_push_back(errors, (object*)string_make_and_format("%sLINE %s%i%s CONTAINS INVALID HEXADECIMAL %s%.*s%s!%s",
+				LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, LIGHT_CYAN, SLICE_ARGS(operand), LIGHT_RED, NEWLINE));
+		}
+		else {
+			state->explicitStart = true;
+			programData->start = programData->end;
+			string_append_slice(programData->name, label.text, label.length);
+		}
+	}
+	if (label.length != 0)
+	{
+		if (!isSymbolText(label.text, label.length))
+		{
+			string* errorMessage = NEW(string);
+			string_format(errorMessage, "%sILLEGAL SYMBOL DEFINITION %s%.*s%s ON LINE %s%i%s\n", LIGHT_RED, LIGHT_CYAN, SLICE_ARGS(label), LIGHT_RED, LIGHT_CYAN, line, NEWLINE);
+			vector_push_back(errors, (object*)errorMessage);
+		}else if (!symbolTable_define(programData->symtab, programData->names, internPool_intern(programData->names, label.text, label.length), line, programData->end))
+		{
+			symbol* dupe = symbolTable_find(programData->symtab, label.text, label.length);
+			vector_push_back( /* ugly */
+				errors, (object*)string_make_and_format(
+				"%sDUPLICATE SYMBOL %s%.*s%s DETECTED ON LINE %s%i%s, DEFINED ON LINE %s%i%s!%s",
+				LIGHT_RED, LIGHT_CYAN, SLICE_ARGS(label), LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, LIGHT_CYAN, dupe->line, LIGHT_RED, NEWLINE
+			));
+		};
+	}
+	if (tokens->mnemonic.length != 0 && !programData->streaming && errors->num == 0) /* pass 2 reads the source again instead, and never runs after an error */
+	{
+		if (!measure->decoded)
+			measure->operand = decodeOperand(tokens, measure->id, &measure->operandValue);
+		instructionStore_push(programData->instructions, tokens, programData->names, line, programData->end,
+			measure->id, what.kind == MNEMONIC_OPCODE ? what.value : 0, measure->operand, measure->operandValue);
+	}
+	if (measure->id == DIRECTIVE_START && state->totalInstructions > 1)
+		vector_push_back(errors, 
+			(object*)string_make_and_format(
+				"%sINVALID DIRECTIVE ON LINE %s%i%s, %sSTART%s IS ONLY VALID AS THE FIRST INSTRUCTION%s", 
+				LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, LIGHT_CYAN, LIGHT_RED, NEWLINE));
+	else if (measure->id == DIRECTIVE_END)
+		state->explicitEnd = true;
+	if (measure->problem != PROBLEM_NONE)
+		pass1_report(tokens, measure, line, errors, programData->warnings);
+	programData->end += measure->size;
+}
+
+/*
+* Parallel pass 1 over a mapped source: each round hands every thread the next PASS1_BATCH lines to tokenize, measure and
+* decode, then places the round's lines in order on the calling thread. Placing is what can't be split (the location counter
+* is the running sum of the sizes, and a symbol is only a duplicate of one defined on an earlier line), it is also the cheap part.
+*/
+#ifndef PASS1_BATCH
+#define PASS1_BATCH 2048 //lines per thread and round, a round's lines are kept until they are placed.
+#endif
+
+typedef struct pass1Line { lineTokens tokens; lineMeasure measure; lineKind kind; } pass1Line;
+typedef struct pass1Chunk { const char* text; const lineMap* maps; unsigned int count; pass1Line* lines; } pass1Chunk;
+
+static void pass1_chunk(void* argument)
+{
+	pass1Chunk* chunk = argument;
+	const char* text = chunk->text;
+	for (unsigned int i = 0; i < chunk->count; ++i)
+	{
+		pass1Line* at = &chunk->lines[i];
+		const lineMap* map = &chunk->maps[i];
+		at->kind = tokenizeLine(text, map->length, map, &at->tokens);
+		if (at->kind == LINE_INSTRUCTION)
+		{
+			pass1_measure(&at->tokens, &at->measure);
+			at->measure.operand = decodeOperand(&at->tokens, at->measure.id, &at->measure.operandValue);
+			at->measure.decoded = true;
+		}
+		text += map->length + 1;
+	}
+}
+
+/* false if the source is streamed or too small to split, nothing is read then. */
+bool pass1_parallel(pass1State* state, source* input, program* programData, unsigned int threads)
+{
+	unsigned int count = minimum(minimum(threads, input->lines / PASS1_BATCH), MAX_WORKERS);
+	if (VALID(input->stream) || count < 2)
+		return false;
+	pass1Line* lines = ALLOCATE(count * PASS1_BATCH, sizeof(pass1Line));
+	pass1Chunk* chunks = ALLOCATE(count, sizeof(pass1Chunk));
+	worker* workers = ALLOCATE(count, sizeof(worker));
+	const char* text = input->text;
+	unsigned int first = 0;
+	while (first < input->lines)
+	{
+		unsigned int made = 0, round = first;
+		for (; made < count && first < input->lines; ++made)
+		{
+			pass1Chunk* chunk = &chunks[made];
+			chunk->text = text;
+			chunk->maps = input->index + first;
+			chunk->count = minimum(PASS1_BATCH, input->lines - first);
+			chunk->lines = lines + made * PASS1_BATCH;
+			for (unsigned int i = 0; i < chunk->count; ++i)
+				text += chunk->maps[i].length + 1;
+			first += chunk->count;
+		}
+		workers_run(workers, made, pass1_chunk, chunks, sizeof(pass1Chunk));
+		for (unsigned int i = 0; i < first - round; ++i)
+			pass1_place(state, programData, lines[i].kind, &lines[i].tokens, &lines[i].measure, round + i + 1, round + i + 1 == input->lines);
 	}
+	input->cursor = input->line = input->lines; /* read through, as the serial loop leaves it */
+	input->last = true;
+	RELEASE(workers);
+	RELEASE(chunks);
+	RELEASE(lines);
+	return true;
+}
 
-	if (!explicitStart)
+/* threads > 1 measures the lines of a mapped source on that many threads, see pass1_parallel. */
+bool pass1(source* input, program* programData, unsigned int threads)
+{
+	vector* errors = NEW(vector);
+	pass1State state = { errors, false, false, false, 0 };
+
+	if (threads < 2 || !pass1_parallel(&state, input, programData, threads))
+	{
+		lineTokens tokens; /* slices of the current line, accepted lines are copied into programData->instructions */
+		lineMeasure measure;
+		const char* view = NULL;
+		unsigned int length = 0;
+		const lineMap* map = NULL;
+		while (source_next(input, &view, &length, &map))
+		{
+			lineKind kind = tokenizeLine(view, length, map, &tokens);
+			if (kind == LINE_INSTRUCTION && !state.explicitEnd)
+				pass1_measure(&tokens, &measure);
+			pass1_place(&state, programData, kind, &tokens, &measure, input->line, input->last);
+		}
+	}
+
+	if (!state.explicitStart)
 		vector_push_back(programData->warnings, (object*)string_make_and_format("%sSTART DIRECTIVE MISSING %sSTART —> 0%s", YELLOW, LIGHT_CYAN, NEWLINE));
 
-	if (!explicitEnd)
+	if (!state.explicitEnd)
 		vector_push_back(programData->warnings, (object*)string_make_and_format("%sEND DIRECTIVE MISSING %sEND —> LAST INSTRUCTION%s", YELLOW, LIGHT_CYAN, NEWLINE));
 
 
-	/* SYMBOL TABLE PRINTING
+	/* SYMBOL TABLE PRINTING (symbols was a formatted row per label, rebuild it from programData->symtab to bring this back)
 	if (symbols->num > 0)
 	{
-		printf("┌────────────────┐\n");
-		printf("│  %sSymbol Table  %s│%s", errors->num == 0 ? GREEN : RED, RESET, NEWLINE);
-		printf("├─────────┬──────┤\n");
+		report("┌────────────────┐\n");
+		report("│  %sSymbol Table  %s│%s", errors->num == 0 ? GREEN : RED, RESET, NEWLINE);
+		report("├─────────┬──────┤\n");
 		for (unsigned int i = 0; i < symbols->num - 1; ++i)
 		{
 			string* symbol = (string*)symbols->data[i];
-			printf("%s", symbol->c_str);
-			printf("├─────────┼──────┤%s",  NEWLINE);
+			report("%s", symbol->c_str);
+			report("├─────────┼──────┤%s",  NEWLINE);
 		}
 
 
 
 		string* symbol = (string*)symbols->data[symbols->num - 1];
-		printf("%s", symbol->c_str);
+		report("%s", symbol->c_str);
 		if (errors->num > 0)
 		{
-			printf("├─────────┴──────┤%s", NEWLINE);
-			printf("│ \33[7m%sPASS 1 ABORTED\33[27m%s │ \n", RED, RESET);
-			printf("└────────────────┘\n");
+			report("├─────────┴──────┤%s", NEWLINE);
+			report("│ \33[7m%sPASS 1 ABORTED\33[27m%s │ \n", RED, RESET);
+			report("└────────────────┘\n");
 		}
 		else {
-			printf("└─────────┴──────┘\n");
+			report("└─────────┴──────┘\n");
 		}
 		
 	}
@@ -685,7 +1867,7 @@ bool pass1(vector* lines, program* programData)
 
 	if (errors->num == 0)
 	{
-		printf("%sProgram Length %lX%s", LIGHT_CYAN, programData->end - programData->start, NEWLINE);
+		report("%sProgram Length %lX%s", LIGHT_CYAN, programData->end - programData->start, NEWLINE);
 	}
 	
 	*/
@@ -696,198 +1878,588 @@ bool pass1(vector* lines, program* programData)
 	if (errors->num > 0)
 	{
 
-		printf("\n %s%i%s ERRORS DETECTED%s", LIGHT_CYAN, errors->num, RED, NEWLINE);
+		report("\n %s%i%s ERRORS DETECTED%s", LIGHT_CYAN, errors->num, RED, NEWLINE);
 
-		printf("┌─────────────────────┐\n");
-		printf("│ \33[7m%sERROR SUMMARY BELOW\33[27m%s │%s", RED, RESET, NEWLINE);
-		printf("└─────────────────────┘\n");
+		report("┌─────────────────────┐\n");
+		report("│ \33[7m%sERROR SUMMARY BELOW\33[27m%s │%s", RED, RESET, NEWLINE);
+		report("└─────────────────────┘\n");
 
 		for (unsigned int i = 0; i < errors->num; ++i)
 		{
 			string* error = (string*)errors->data[i];
-			printf(" %s%u.%s %s", LIGHT_CYAN, i+1, RESET, error->c_str);
+			report(" %s%u.%s %s", LIGHT_CYAN, i+1, RESET, error->c_str);
 		}
 	}
 
 	bool passed = errors->num == 0;
 
-	/* We take ownership */
-	DELETE(lines);  DELETE(symbols); DELETE(errors);
+	DELETE(errors);
 
 	return passed;
 }
 
-void writeTRecord(string* output, string** data, unsigned int* location)
+/*
+* Object record writer. Records are built in place in one output buffer of RECORD_BUFFER bytes, which goes to the sink whenever
+* it fills up (and after every T-record with flushEach, so a filter's reader sees each one as soon as it is complete).
+* Nothing is allocated per record and the object never has to fit in memory. The open T-record is the tail of the buffer:
+* 'T', its address (start), a length placeholder and its digits so far; closing it fills in the length. A record that outgrows
+* the whole buffer (only a very long X literal can) grows it. Without a sink nothing is written, the buffer just grows to hold it all.
+*/
+#ifndef RECORD_BUFFER
+#define RECORD_BUFFER (1 << 16)
+#endif
+typedef struct recordStats { unsigned long records; unsigned long long bytes; unsigned long long characters; } recordStats; //T-records only, characters include the newline.
+
+typedef struct recordWriter {
+	FILE* sink; bool flushEach;
+	char* buffer; unsigned int used; unsigned int limit;
+	bool open; unsigned int record; //offset of the open T-record's 'T'
+	unsigned int start; //address of the open (or next) T-record
+	recordStats stats;
+	bool failed; //a write to the sink came up short, the object is incomplete
+} recordWriter;
+
+#define RECORD_PREFIX 9 /* T, 6 address digits, 2 length digits */
+
+void records_begin(recordWriter* writer, FILE* sink, bool flushEach, unsigned int start)
 {
-	unsigned int length = (*data)->length / 2 + (*data)->length % 2;
-	string_format(output, "T%06X%02X%s\n", *location, length, (*data)->c_str);
-	DELETE(*data);
-	*data = NEW(string); //clear buffer completely...
-	*location += length;
+	recordWriter fresh = { sink, flushEach, ALLOCATE(RECORD_BUFFER, sizeof(char)), 0, RECORD_BUFFER, false, 0, start, { 0, 0, 0 }, false };
+	*writer = fresh;
 }
 
-#define CAST(A, B) ((B*) A)
+/* writes out everything before the open record and moves the record to the front of the buffer. */
+void records_flush(recordWriter* writer)
+{
+	unsigned int finished = writer->open ? writer->record : writer->used;
+	if (fwrite(writer->buffer, 1, finished, writer->sink) != finished)
+		writer->failed = true;
+	memmove(writer->buffer, writer->buffer + finished, writer->used - finished);
+	writer->used -= finished;
+	writer->record = 0;
+	if (writer->flushEach && fflush(writer->sink) != 0)
+		writer->failed = true;
+}
 
-unsigned int minimum(unsigned int A, unsigned int B)
+static char* records_room(recordWriter* writer, unsigned int length)
 {
-	return A < B ? A : B; //returns the smaller of 2 ints.
+	if (writer->used + length > writer->limit && VALID(writer->sink))
+		records_flush(writer);
+	if (writer->used + length > writer->limit)
+	{
+		while (writer->used + length > writer->limit)
+			writer->limit <<= 1;
+		writer->buffer = REALLOCATE(writer->buffer, writer->limit);
+	}
+	return writer->buffer + writer->used;
 }
 
-bool pass2(program* programData, string* output)
+/* a whole record (H or E) or any other text outside a T-record. */
+void records_write(recordWriter* writer, const char* text, unsigned int length)
 {
-	vector* errors = NEW(vector);
-	if (programData->name->length == 0)
+	memcpy(records_room(writer, length), text, length);
+	writer->used += length;
+	if (writer->flushEach)
+		records_flush(writer);
+}
+
+unsigned int records_digits(const recordWriter* writer) //digits in the open T-record, 0 if none is open.
+{
+	return writer->open ? writer->used - writer->record - RECORD_PREFIX : 0;
+}
+
+/* adds hex digits to the T-record, opening one at start if needed. */
+void records_append(recordWriter* writer, const char* digits, unsigned int length)
+{
+	if (length == 0)
+		return;
+	if (!writer->open)
 	{
-		vector_push_back(programData->warnings, (object*)string_make_and_format("%sPROGRAM NAME MISSING, %sNAME —> NONAME%s", YELLOW, LIGHT_CYAN, NEWLINE));
-		string_format(output, "H%-6s%06X%06X\n", "NONAME", programData->start, programData->end - programData->start);
+		char* prefix = records_room(writer, RECORD_PREFIX);
+		writer->record = writer->used;
+		prefix[0] = 'T';
+		formatHex(prefix + 1, writer->start, 6);
+		writer->used += RECORD_PREFIX;
+		writer->open = true;
 	}
-	else {
-		string_format(output, "H%-6s%06X%06X\n", programData->name->c_str, programData->start, programData->end - programData->start);
+	memcpy(records_room(writer, length), digits, length);
+	writer->used += length;
+}
+
+void records_close(recordWriter* writer);
+
+/* adds hex digits, closing the T-record whenever it holds width digits and more follow. */
+void records_fill(recordWriter* writer, const char* digits, unsigned int length, unsigned int width)
+{
+	while (length > 0)
+	{
+		if (records_digits(writer) >= width)
+			records_close(writer);
+		unsigned int take = minimum(width - records_digits(writer), length);
+		records_append(writer, digits, take);
+		digits += take;
+		length -= take;
 	}
-	
+}
+
+/* closes the T-record, an empty one if none is open, and moves start past it. */
+void records_close(recordWriter* writer)
+{
+	if (!writer->open)
+	{
+		char* prefix = records_room(writer, RECORD_PREFIX);
+		writer->record = writer->used;
+		prefix[0] = 'T';
+		formatHex(prefix + 1, writer->start, 6);
+		writer->used += RECORD_PREFIX;
+		writer->open = true;
+	}
+	unsigned int digits = records_digits(writer);
+	unsigned int length = digits / 2 + digits % 2;
+	char field[8];
+	unsigned int width = formatHex(field, length, 2);
+	records_room(writer, width - 2 + 1);
+	char* body = writer->buffer + writer->record + RECORD_PREFIX;
+	if (width > 2) /* more than 255 bytes, the length takes more than its 2 digits */
+		memmove(body + width - 2, body, digits);
+	memcpy(body - 2, field, width);
+	writer->used += width - 2;
+	writer->buffer[writer->used++] = '\n';
+	writer->open = false;
+	writer->start += length;
+	writer->stats.records += 1;
+	writer->stats.bytes += length;
+	writer->stats.characters += writer->used - writer->record;
+	if (writer->flushEach)
+		records_flush(writer);
+}
 
-	unsigned int lineStart = programData->start;
-	string* builder = NEW(string);
+/*
+* copies the closed T-records of part, written without a sink and with addresses counted from 0, in after the records
+* written so far and moves them to start there. Every address has to stay within 6 digits.
+*/
+void records_splice(recordWriter* writer, const recordWriter* part)
+{
+	unsigned int base = writer->start;
+	for (unsigned int at = 0; at < part->used;)
+	{
+		const char* record = part->buffer + at;
+		unsigned int length = (unsigned int)((const char*)memchr(record, '\n', part->used - at) - record) + 1;
+		unsigned long address = 0;
+		parseHex((slice){ record + 1, 6 }, &address);
+		char* out = records_room(writer, length);
+		memcpy(out, record, length);
+		formatHex(out + 1, base + (unsigned int)address, 6);
+		writer->used += length;
+		if (writer->flushEach)
+			records_flush(writer);
+		at += length;
+	}
+	writer->start = base + part->start;
+	writer->stats.records += part->stats.records;
+	writer->stats.bytes += part->stats.bytes;
+	writer->stats.characters += part->stats.characters;
+}
 
-	for (unsigned int i = 0; i < programData->instructions->num; ++i)
+/* writes out what is left, false when any of the records did not make it to the sink. */
+bool records_end(recordWriter* writer)
+{
+	if (VALID(writer->sink))
 	{
-		instruction* what = (instruction*)programData->instructions->data[i];
-		if (strcmp(what->opcode->c_str, "START") == 0)
-			continue; /* these are checked in pass 1 */
+		records_flush(writer);
+		if (fflush(writer->sink) != 0 || ferror(writer->sink))
+			writer->failed = true;
+	}
+	RELEASE(writer->buffer);
+	writer->buffer = NULL;
+	return !writer->failed;
+}
+
+/*
+* How object code is packed into T-records. GREEDY starts a new record when the next instruction would not fit in 60 digits,
+* INSTRUCTION gives every instruction its own record and FULL fills every record to 30 bytes, splitting instructions and
+* data across records (the loader just places bytes, so only a RESB/RESW gap has to end a record).
+*/
+typedef enum packing { PACK_GREEDY, PACK_INSTRUCTION, PACK_FULL, PACKINGS } packing;
+static const char* const packingNames[PACKINGS] = { "greedy", "instruction", "full" };
+#if EXPANDED
+#define DEFAULT_PACKING PACK_INSTRUCTION //EXPANDED builds keep one record per instruction unless told otherwise.
+#else
+#define DEFAULT_PACKING PACK_GREEDY
+#endif
 
-		string* part = NEW(string);
-		int opcode = 0;
-		if (isDirective(what->opcode) && strcmp(what->opcode->c_str, "END") != 0)
+/* Everything pass 2 carries from one instruction to the next. scratch holds the object code of one instruction. */
+typedef struct pass2State { vector* errors; recordWriter* records; packing packing; char scratch[16]; } pass2State;
+
+#define CAST(A, B) ((B*) A)
+
+/*
+* One instruction as pass 2 sees it: what pass 1 classified and decoded, plus its label, mnemonic and operand text, which
+* only the BYTE payload and error messages read.
+*/
+typedef struct decodedInstruction {
+	unsigned int line; unsigned int id; unsigned int opcode; unsigned char operand; unsigned long long value;
+	const lineTokens* tokens;
+} decodedInstruction;
+
+/*
+* Pass 2 emitters, one per instructionId (see pass2Emitters). Each points part at its object code (state->scratch or the source),
+* pass2_instruction then places part in the current T-record. Operands were validated by pass 1.
+*/
+typedef void (*pass2Emitter)(pass2State* state, program* programData, const decodedInstruction* what, slice* part);
+
+/* machine instructions and END, which only sets the first instruction when it has a nonzero operand and otherwise emits like an opcode 0. */
+static void pass2_operand(pass2State* state, program* programData, const decodedInstruction* what, unsigned int opcode, slice* part, bool end)
+{
+	const lineTokens* tokens = what->tokens;
+	unsigned int line = what->line;
+	slice mnemonicText = tokens->mnemonic;
+	slice operand = tokens->operand;
+	unsigned long operand_value = 0;
+	if (operandToValue(what->operand, what->value, programData, &operand_value))
+	{
+		if (end && operand_value != 0)
 		{
-			if (strcmp(what->opcode->c_str, "BYTE") == 0)
-			{
-				vector* parts = NEW(vector);
-				string_split(what->operand, parts, "'");
-
-				if (strcmp(((string*)parts->data[0])->c_str, "C") == 0)
-				{
-					toHex(CAST(parts->data[1], string)->c_str, part);
-					int read = 0;
-					char buffer[61] = { 0 };
-					while (part->length - read > 60)
-					{
-						
-						strncpy(buffer, part->c_str + read, 60);
-						string_format(builder, "%s", buffer);
-						writeTRecord(output, &builder, &lineStart);
-						read += 60;
-					}
-					if (part->length - read > 0)
-					{
-						strcpy(buffer, part->c_str + read);
-						string_format(builder, "%s", buffer);
-					}
-					DELETE(part); part = NEW(string);
-				}
-				else { /*X*/
-					string_append(part, CAST(parts->data[1], string)->c_str);
-				}
-				DELETE(parts);
-			}
-			else if (strcmp(what->opcode->c_str, "RESB") == 0)
+			if (programData->firstInstruction != operand_value)
 			{
-				if (builder->length != 0)
-					writeTRecord(output, &builder, &lineStart);
-				long val = 0;
-				fromDecimal(what->operand->c_str, &val); /* checked in pass 1 */
-				lineStart += val;
-			}
-			else if (strcmp(what->opcode->c_str, "RESW") == 0)
-			{
-				if (builder->length != 0)
-					writeTRecord(output, &builder, &lineStart);
-				long val = 0;
-				fromDecimal(what->operand->c_str, &val); /* checked in pass 1 */
-				lineStart += val * 3;
-			}
-			else if (strcmp(what->opcode->c_str, "WORD") == 0)
-			{
-				long val = 0;
-				fromDecimal(what->operand->c_str, &val); /* checked in pass 1 */
-				string_format(part, "%06X", val);
+				vector_push_back(programData->warnings, (object*)string_make_and_format(
+					"%sINCORRECT VALUE FOR END, EXPECTED != ACTUAL (%s%X != %X%s) ON LINE %s%i%s!%s",
+					YELLOW, LIGHT_CYAN, programData->firstInstruction, operand_value, YELLOW, LIGHT_CYAN, line, YELLOW, NEWLINE));
 			}
+			programData->firstInstruction = operand_value;
 		}
-		else if(isOPCode(what->opcode, &opcode) || strcmp(what->opcode->c_str, "END") == 0)
+		else {
+			unsigned int length = formatHex(state->scratch, opcode, 2);
+			length += formatHex(state->scratch + length, (unsigned int)operand_value, 4);
+			*part = (slice){ state->scratch, length };
+		}
+		
+	}
+	else {
+		lineTokens split = *tokens; /* error path only, the store keeps the operand whole */
+		splitOperand(&split, LINEMAP_COMMAS);
+		slice symbol = split.operandBase;
+		bool isSymbol = (what->operand & OPERAND_KIND_MASK) == OPERAND_SYMBOL;
+		symbol.length = trimmedLength(symbol.text, symbol.length);
+		if (isSymbol)
 		{
-			unsigned long operand_value = 0;
-			if (operandToValue(what->operand, programData, &operand_value))
-			{
-				if (strcmp(what->opcode->c_str, "END") == 0 && operand_value != 0)
-				{
-					if (programData->firstInstruction != operand_value)
-					{
-						vector_push_back(programData->warnings, (object*)string_make_and_format(
-							"%sINCORRECT VALUE FOR END, EXPECTED != ACTUAL (%s%X != %X%s) ON LINE %s%i%s!%s",
-							YELLOW, LIGHT_CYAN, programData->firstInstruction, operand_value, YELLOW, LIGHT_CYAN, what->line, YELLOW, NEWLINE));
-					}
-					programData->firstInstruction = operand_value;
-				}
-				else {
-					string_format(part, "%02X%04X", opcode, operand_value);
-				}
-				
-			}
-			else {
-				vector* getFirst = NEW(vector);
-				string_split(what->operand, getFirst, ",");
-				string* symbol = CAST(getFirst->data[0], string);
-				if (isSymbol(symbol))
-				{
-					vector_push_back(errors, (object*)string_make_and_format(
-						"%sUNDEFINED SYMBOL %s%s%s FOR %s%s%s %s%s ON LINE %s%i%s!%s",
-						LIGHT_RED, LIGHT_CYAN, removeWhitespace(symbol)->c_str, LIGHT_RED, LIGHT_CYAN, what->symbol->c_str, what->opcode->c_str, what->operand->c_str, LIGHT_RED, LIGHT_CYAN, what->line, LIGHT_RED, NEWLINE));
-				}
-				else {
-					vector_push_back(errors, (object*)string_make_and_format(
-						"%sUNDEFINED OPERAND %s%s%s FOR %s%s%s ON LINE %s%i%s!%s",
-						LIGHT_RED, LIGHT_CYAN, removeWhitespace(symbol)->c_str, LIGHT_RED, LIGHT_CYAN, what->opcode->c_str, LIGHT_RED, LIGHT_CYAN, what->line, LIGHT_RED, NEWLINE));
-				}
-				DELETE(getFirst);
-				
-			}
-			
+			vector_push_back(state->errors, (object*)string_make_and_format(
+				"%sUNDEFINED SYMBOL %s%.*s%s FOR %s%.*s%.*s %.*s%s ON LINE %s%i%s!%s",
+				LIGHT_RED, LIGHT_CYAN, SLICE_ARGS(symbol), LIGHT_RED, LIGHT_CYAN, SLICE_ARGS(tokens->label), SLICE_ARGS(mnemonicText), SLICE_ARGS(operand), LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, NEWLINE));
+		}
+		else {
+			vector_push_back(state->errors, (object*)string_make_and_format(
+				"%sUNDEFINED OPERAND %s%.*s%s FOR %s%.*s%s ON LINE %s%i%s!%s",
+				LIGHT_RED, LIGHT_CYAN, SLICE_ARGS(symbol), LIGHT_RED, LIGHT_CYAN, SLICE_ARGS(mnemonicText), LIGHT_RED, LIGHT_CYAN, line, LIGHT_RED, NEWLINE));
+		}
+		
+	}
+}
+
+static void pass2_opcode(pass2State* state, program* programData, const decodedInstruction* what, slice* part)
+{
+	pass2_operand(state, programData, what, what->opcode, part, false);
+}
+
+static void pass2_end(pass2State* state, program* programData, const decodedInstruction* what, slice* part)
+{
+	pass2_operand(state, programData, what, 0, part, true);
+}
+
+/*
+* C literals go straight into the T-record 60 digits at a time, closing it after each full 60 while more digits follow,
+* the rest stays open (FULL packing just keeps filling records). X literals are their payload text.
+*/
+static void pass2_byte(pass2State* state, program* programData, const decodedInstruction* what, slice* part)
+{
+	(void)programData; /* the emitters share one signature for the dispatch table */
+	slice payload = { what->tokens->operand.text + 2, (unsigned int)what->value };
+	if (what->operand != OPERAND_CHARS)
+	{
+		*part = payload;
+		return;
+	}
+	unsigned int total = toHexLength(payload.text, payload.length), written = 0;
+	char digits[30 * 8];
+	for (unsigned int read = 0; read < payload.length; read += 30)
+	{
+		unsigned int length = toHex(payload.text + read, minimum(30, payload.length - read), digits);
+		if (state->packing == PACK_FULL)
+		{
+			records_fill(state->records, digits, length, 60);
+			continue;
 		}
+		for (unsigned int used = 0; used < length;)
+		{
+			unsigned int take = minimum(60 - written % 60, length - used);
+			records_append(state->records, digits + used, take);
+			used += take;
+			written += take;
+			if (written % 60 == 0 && written < total)
+				records_close(state->records);
+		}
+	}
+}
+
+static void pass2_word(pass2State* state, program* programData, const decodedInstruction* what, slice* part)
+{
+	(void)programData;
+	*part = (slice){ state->scratch, formatHex(state->scratch, (unsigned int)what->value, 6) };
+}
+
+static void pass2_reserveBytes(pass2State* state, program* programData, const decodedInstruction* what, slice* part)
+{
+	(void)programData; (void)part;
+	if (records_digits(state->records) != 0)
+		records_close(state->records);
+	state->records->start += (unsigned int)what->value;
+}
+
+static void pass2_reserveWords(pass2State* state, program* programData, const decodedInstruction* what, slice* part)
+{
+	(void)programData; (void)part;
+	if (records_digits(state->records) != 0)
+		records_close(state->records);
+	state->records->start += (unsigned int)what->value * 3;
+}
+
+static void pass2_nothing(pass2State* state, program* programData, const decodedInstruction* what, slice* part)
+{
+	(void)state; (void)programData; (void)what; (void)part;
+}
+
+/* NULL skips the instruction entirely, START is fully handled by pass 1. */
+static const pass2Emitter pass2Emitters[INSTRUCTION_IDS] = {
+	[DIRECTIVE_END] = pass2_end, [DIRECTIVE_BYTE] = pass2_byte, [DIRECTIVE_WORD] = pass2_word,
+	[DIRECTIVE_RESB] = pass2_reserveBytes, [DIRECTIVE_RESW] = pass2_reserveWords, [DIRECTIVE_RESR] = pass2_nothing,
+	[DIRECTIVE_EXPORTS] = pass2_nothing, [DIRECTIVE_START] = NULL, [INSTRUCTION_OPCODE] = pass2_opcode, [INSTRUCTION_UNKNOWN] = pass2_nothing
+};
+
+/* emits the object code of one instruction accepted by pass 1. */
+void pass2_instruction(pass2State* state, program* programData, const decodedInstruction* what)
+{
+	pass2Emitter emit = pass2Emitters[what->id];
+	if (!VALID(emit))
+		return;
+	slice part = { state->scratch, 0 };
+	emit(state, programData, what, &part);
+
+	switch (state->packing)
+	{
+	case PACK_INSTRUCTION:
+		if (records_digits(state->records) > 0)
+			records_close(state->records);
+		records_append(state->records, part.text, part.length);
+		break;
+	case PACK_FULL:
+		records_fill(state->records, part.text, part.length, 60);
+		break;
+	default:
+		if (records_digits(state->records) + part.length > 60)
+			records_close(state->records);
+		records_append(state->records, part.text, part.length);
+		break;
+	}
+}
+
+/* emits instructions [first, last) of the store. */
+void pass2_store(pass2State* state, program* programData, unsigned int first, unsigned int last)
+{
+	instructionStore* store = programData->instructions;
+	lineTokens tokens;
+	decodedInstruction what = { 0, 0, 0, 0, 0, &tokens };
+	for (unsigned int i = first; i < last; ++i)
+	{
+		tokens.label = internPool_slice(programData->names, store->labels[i]);
+		tokens.mnemonic = internPool_slice(programData->names, store->opcodes[i]);
+		tokens.operand = internPool_slice(programData->names, store->operands[i]);
+		what.line = store->lines[i];
+		what.id = store->ids[i];
+		what.opcode = store->codes[i];
+		what.operand = store->operandKinds[i];
+		what.value = store->operandValues[i];
+		pass2_instruction(state, programData, &what);
+	}
+}
+
+/*
+* Parallel pass 2. Once pass 1 is done the symbol table is frozen and the store holds every instruction, so the store is cut
+* into chunks right before a RESB/RESW (every packing closes the open T-record there, whatever came before it) and each chunk
+* is encoded on its own thread into a private record buffer, addresses counted from 0. The buffers are spliced in order, each
+* rebased onto the address the chunk before it ended at, which gives exactly the records of the serial loop. Diagnostics are
+* collected per chunk and merged in chunk (so line) order.
+*/
+#ifndef PASS2_MIN_CHUNK
+#define PASS2_MIN_CHUNK 2048 //instructions per thread, below this starting a thread costs more than it saves.
+#endif
+
+typedef struct pass2Chunk {
+	program local; //the program with this chunk's own warnings and symbol table (stats)
+	symbolTable symtab;
+	unsigned int first; unsigned int last; //store indices [first, last)
+	bool final; //ends the program, closes its last record unconditionally like pass 2 does
+	packing packing;
+	vector* errors;
+	recordWriter records;
+} pass2Chunk;
+
+static void pass2_chunk(void* argument)
+{
+	pass2Chunk* chunk = argument;
+	chunk->errors = NEW(vector);
+	chunk->local.warnings = NEW(vector);
+	records_begin(&chunk->records, NULL, false, 0);
+	pass2State state = { chunk->errors, &chunk->records, chunk->packing, { 0 } };
+	pass2_store(&state, &chunk->local, chunk->first, chunk->last);
+	if (chunk->final || records_digits(&chunk->records) != 0)
+		records_close(&chunk->records);
+}
+
+static void moveDiagnostics(vector* into, vector* from) /* copies, from may hold another thread's heap strings */
+{
+	for (unsigned int i = 0; i < from->num; ++i)
+		vector_push_back(into, (object*)string_make_and_format("%s", ((string*)from->data[i])->c_str));
+	DELETE(from);
+}
+
+/* false if the store is too small to split (or the program too big to rebase), nothing is emitted then. */
+bool pass2_parallel(pass2State* state, program* programData, unsigned int threads)
+{
+	instructionStore* store = programData->instructions;
+	unsigned int count = minimum(minimum(threads, store->num / PASS2_MIN_CHUNK), MAX_WORKERS);
+	if (count < 2)
+		return false;
+	pass2Chunk* chunks = ALLOCATE(count, sizeof(pass2Chunk));
+	worker* workers = ALLOCATE(count, sizeof(worker));
+	unsigned int made = 0, first = 0;
+	while (first < store->num && made < count)
+	{
+		unsigned int last = made + 1 == count ? store->num : maximum(store->num / count * (made + 1), first + 1);
+		while (last < store->num && store->ids[last] != DIRECTIVE_RESB && store->ids[last] != DIRECTIVE_RESW)
+			++last;
+		pass2Chunk* chunk = &chunks[made++];
+		chunk->local = *programData;
+		chunk->symtab = *programData->symtab;
+		chunk->symtab.stats = (probeStats){ 0, 0, 0 };
+		chunk->local.symtab = &chunk->symtab;
+		chunk->first = first;
+		chunk->last = last;
+		chunk->final = last == store->num;
+		chunk->packing = state->packing;
+		first = last;
+	}
+	workers_run(workers, made, pass2_chunk, chunks, sizeof(pass2Chunk));
 
-#if EXPANDED
-		if (builder->length > 0)
+	unsigned long end = state->records->start;
+	for (unsigned int i = 0; i < made; ++i)
+		end += chunks[i].records.start;
+	bool spliced = end < 0x1000000;
+	for (unsigned int i = 0; i < made; ++i)
+	{
+		pass2Chunk* chunk = &chunks[i];
+		if (spliced)
 		{
-			writeTRecord(output, &builder, &lineStart);
+			records_splice(state->records, &chunk->records);
+			moveDiagnostics(state->errors, chunk->errors);
+			moveDiagnostics(programData->warnings, chunk->local.warnings);
+			if (chunk->local.firstInstruction != programData->firstInstruction)
+				programData->firstInstruction = chunk->local.firstInstruction; /* END */
+			probeStats* stats = &programData->symtab->stats;
+			stats->lookups += chunk->symtab.stats.lookups;
+			stats->probes += chunk->symtab.stats.probes;
+			stats->longest = maximum(stats->longest, chunk->symtab.stats.longest);
 		}
-#else
-		if (builder->length + part->length > 60)
-		{
-			writeTRecord(output, &builder, &lineStart);
+		else {
+			DELETE(chunk->errors);
+			DELETE(chunk->local.warnings);
 		}
-#endif
-		string_format(builder, "%s", part->c_str);
-		DELETE(part);
+		records_end(&chunk->records);
+	}
+	RELEASE(workers);
+	RELEASE(chunks);
+	return spliced;
+}
+
+typedef struct pass2Options { bool flushEach; packing packing; unsigned int threads; } pass2Options;
+
+/*
+* writes the object records to sink as they are produced, flushEach flushes every one. The E record only follows a clean pass 2.
+* options.threads > 1 encodes the store on that many threads (see pass2_parallel). stats (may be NULL) receives the T-record counts.
+*/
+bool pass2(program* programData, source* input, FILE* sink, pass2Options options, recordStats* stats) /* input is only read when programData->streaming */
+{
+	vector* errors = NEW(vector);
+	recordWriter records;
+	records_begin(&records, sink, options.flushEach, (unsigned int)programData->start);
+	char header[64];
+	const char* name = programData->name->c_str;
+	if (programData->name->length == 0)
+	{
+		vector_push_back(programData->warnings, (object*)string_make_and_format("%sPROGRAM NAME MISSING, %sNAME —> NONAME%s", YELLOW, LIGHT_CYAN, NEWLINE));
+		name = "NONAME";
 	}
+	int headerLength = snprintf(header, sizeof(header), "H%-6s%06X%06X\n", name, (unsigned int)programData->start, (unsigned int)(programData->end - programData->start));
+	records_write(&records, header, (unsigned int)minimum(headerLength, sizeof(header) - 1));
 
-	writeTRecord(output,&builder, &lineStart);
-	string_format(output, "E%06X\n", programData->firstInstruction);
+	pass2State state = { errors, &records, options.packing, { 0 } };
 
-	DELETE(builder);
+	bool spliced = false; //the chunks closed the last record already
+	if (!programData->streaming)
+	{
+		spliced = options.threads > 1 && pass2_parallel(&state, programData, options.threads);
+		if (!spliced)
+			pass2_store(&state, programData, 0, programData->instructions->num);
+	}
+	else if (!source_rewind(input))
+	{
+		vector_push_back(errors, (object*)string_make_and_format("%sUNABLE TO READ THE SOURCE AGAIN FOR PASS 2!%s", LIGHT_RED, NEWLINE));
+	}
+	else {
+		/* second streaming read, accepting lines by the same rules pass 1 used to fill the store */
+		lineTokens tokens;
+		const char* view = NULL;
+		unsigned int length = 0;
+		const lineMap* map = NULL;
+		bool ended = false;
+		while (!ended && source_next(input, &view, &length, &map))
+		{
+			if (tokenizeLine(view, length, map, &tokens) != LINE_INSTRUCTION || tokens.mnemonic.length == 0)
+				continue;
+			mnemonic kind = classifyMnemonic(tokens.mnemonic.text, tokens.mnemonic.length);
+			decodedInstruction what = { input->line, mnemonicId(kind), kind.kind == MNEMONIC_OPCODE ? kind.value : 0, 0, 0, &tokens };
+			what.operand = decodeOperand(&tokens, what.id, &what.value);
+			pass2_instruction(&state, programData, &what);
+			ended = what.id == DIRECTIVE_END;
+		}
+	}
+	if (!spliced)
+		records_close(&records);
+	if (errors->num == 0)
+	{
+		char end[16] = "E";
+		unsigned int length = 1 + formatHex(end + 1, (unsigned int)programData->firstInstruction, 6);
+		end[length++] = '\n';
+		records_write(&records, end, length);
+	}
+	if (VALID(stats))
+		*stats = records.stats;
+	if (!records_end(&records))
+		vector_push_back(errors, (object*)string_make_and_format("%sUNABLE TO WRITE THE OBJECT RECORDS!%s", LIGHT_RED, NEWLINE));
 
 	if (programData->warnings->num > 0 && errors->num > 0)
 		printWarnings(programData->warnings);
 	if (errors->num > 0)
 	{
 
-		printf("\n %s%i%s ERRORS DETECTED%s", LIGHT_CYAN, errors->num, RED, NEWLINE);
+		report("\n %s%i%s ERRORS DETECTED%s", LIGHT_CYAN, errors->num, RED, NEWLINE);
 
-		printf("┌─────────────────────┐\n");
-		printf("│ \33[7m%sERROR SUMMARY BELOW\33[27m%s │%s", RED, RESET, NEWLINE);
-		printf("└─────────────────────┘\n");
+		report("┌─────────────────────┐\n");
+		report("│ \33[7m%sERROR SUMMARY BELOW\33[27m%s │%s", RED, RESET, NEWLINE);
+		report("└─────────────────────┘\n");
 
 		for (unsigned int i = 0; i < errors->num; ++i)
 		{
 			string* error = (string*)errors->data[i];
-			printf(" %s%u.%s %s", LIGHT_CYAN, i + 1, RESET, error->c_str);
+			report(" %s%u.%s %s", LIGHT_CYAN, i + 1, RESET, error->c_str);
 		}
 	}
 
@@ -899,83 +2471,187 @@ bool pass2(program* programData, string* output)
 
 }
 
-int MAIN(int argc, char* argv[])
+/* overhead is every T-record character that isn't object code: the T, address, length and newline. */
+void recordStats_print(const char* packingName, const recordStats* stats)
 {
-	if (argc != 2)
-	{
-		printf("USAGE: %s <filename>\n", argv[0]);
-		return -1;
-	}
+	unsigned long long overhead = stats->characters - stats->bytes * 2;
+	report("%s%s packing%s: %lu T-records, %llu bytes of object code in %llu characters, %llu overhead (%u%%)%s",
+		LIGHT_CYAN, packingName, RESET, stats->records, stats->bytes, stats->characters, overhead,
+		stats->characters == 0 ? 0 : (unsigned int)(overhead * 100 / stats->characters), NEWLINE);
+}
 
-	file* fileInstructions = NEW(file);
-	string* fileContents = NEW(string);
+/*
+* Assembles one source file into <path>.obj. Everything it touches is owned by the call (its own arena, tables and the
+* calling thread's diagnostics), so several assemblies can run at once on different threads.
+* With options.stream the source is read in chunks twice (once per pass) instead of being mapped and kept as an instruction store,
+* and nothing comes from an arena, so per-line scratch is really freed and memory only grows with the symbol table.
+* A path of "-" makes it a filter: source from stdin, records to stdout (each T record flushed as soon as it is complete),
+* diagnostics to stderr. Records already written stay written if pass 2 fails, but the E record only follows a clean pass 2.
+*/
+typedef struct assembleOptions { bool stream; packing packing; bool recordStats; unsigned int threads; } assembleOptions; //threads 0 or 1 = both passes on the calling thread
 
-	file_open(fileInstructions, argv[1], "r");
-	file_readAll(fileInstructions, fileContents);
-	DELETE(fileInstructions);
+int assemble(const char* path, assembleOptions options)
+{
+	bool filter = strcmp(path, "-") == 0;
+	FILE* diagnosticsStream = filter ? redirectDiagnostics(stderr) : NULL;
+	if (filter && options.stream && fseek(stdin, 0, SEEK_CUR) != 0)
+	{
+		report("%s--stream NEEDS AN INPUT THAT CAN BE READ TWICE, READING ALL OF STDIN INSTEAD%s", YELLOW, NEWLINE);
+		options.stream = false; /* a pipe can't be rewound for pass 2 */
+	}
+#if USE_ARENA
+	arena* assembly = options.stream ? NULL : ARENA_BEGIN(); /* everything below lives as long as the assembly does */
+#endif
+	source* input = NEW(source);
 
-	if (fileContents->length == 0)
+	if (!(options.stream ? source_stream(input, path) : source_open(input, path)))
 	{
-		printf("\n%sINVALID FILE, ASSEMBLER CAN NOT CONTINUE!%s\n", LIGHT_RED, NEWLINE);
-		DELETE(fileContents);
+		report("\n%sINVALID FILE, ASSEMBLER CAN NOT CONTINUE!%s\n", LIGHT_RED, NEWLINE);
+		DELETE(input);
+#if USE_ARENA
+		ARENA_END(assembly);
+#endif
+		if (filter)
+			redirectDiagnostics(diagnosticsStream);
 		return -1;
 	}
 
 	int status = 0; //assembler status
 
-	/*gets the lines of the file*/
-	vector* lines = NEW(vector);
-	program programData = { 0, 0, -1, NEW(string), NEW(hashTable), NEW(vector), NEW(vector) };
+	program programData = { 0, 0, -1, NEW(string), NEW(symbolTable), NEW(instructionStore), NEW(vector), NEW(internPool), options.stream };
 
-	string_split(fileContents, lines, "\n");
-	DELETE(fileContents);
+	if (!options.stream) /* a stream only ever indexes one chunk, nothing to pre-size from */
+	{
+		instructionStore_reserve(programData.instructions, input->lines);
+		symbolTable_reserve(programData.symtab, input->labels);
+		internPool_reserve(programData.names, input->labels);
+	}
 
-	if (!pass1(lines, &programData))
+	bool passed = pass1(input, &programData, options.threads);
+	if (!options.stream)
+		DELETE(input); /* pass 2 only reads the instruction store */
+	if (!passed)
 	{
-		printf("%sPASS 1 FAIL, STOPPING ASSEMBLY%s", RED, NEWLINE);
+		report("%sPASS 1 FAIL, STOPPING ASSEMBLY%s", RED, NEWLINE);
 		status = -1;
 	}
 	else {
-		string* objectCode = NEW(string);
-		if (!pass2(&programData, objectCode))
+		/* records go to <path>.obj.part and only replace <path>.obj once pass 2 passed and every record reached the file, so a failed run leaves no partial object behind */
+		string* fileName = NEW(string);
+		string_append(fileName, path);
+		string_append(fileName, ".obj");
+		string* partName = NEW(string);
+		string_format(partName, "%s.part", fileName->c_str);
+		file* fileObjectFile = NEW(file);
+		recordStats stats = { 0, 0, 0 };
+		if (!filter)
+			file_open(fileObjectFile, partName->c_str, "w");
+		if (!filter && !VALID(fileObjectFile->handle))
+		{
+			report("%sUNABLE TO WRITE %s%s%s!%s", LIGHT_RED, LIGHT_CYAN, fileName->c_str, LIGHT_RED, NEWLINE);
+			status = -1;
+		}
+		else if (!pass2(&programData, input, filter ? stdout : fileObjectFile->handle,
+			(pass2Options){ filter, options.packing, options.threads }, &stats))
 		{
-			printf("%sPASS 2 FAIL, STOPPING ASSEMBLY%s", RED, NEWLINE);
+			report("%sPASS 2 FAIL, STOPPING ASSEMBLY%s", RED, NEWLINE);
 			status = -1;
 		}
 		else {
 			if (programData.warnings->num > 0)
 				printWarnings(programData.warnings);
-			string* fileName = NEW(string);
-			string_append(fileName, argv[1]);
-			string_append(fileName, ".obj");
-			file* fileObjectFile = NEW(file);
-			file_open(fileObjectFile, fileName->c_str, "w");
-			fprintf(fileObjectFile->handle, "%s", objectCode->c_str);
+			if (options.recordStats)
+				recordStats_print(packingNames[options.packing], &stats);
+		}
+		if (!filter && VALID(fileObjectFile->handle))
+		{
 			file_close(fileObjectFile);
-			DELETE(fileObjectFile);
-			DELETE(fileName);
-			
+			if (status != 0)
+				remove(partName->c_str); /* incomplete, the previous object stays as it was */
+#if defined(_WIN32)
+			else if (!MoveFileExA(partName->c_str, fileName->c_str, MOVEFILE_REPLACE_EXISTING)) /* rename won't replace an existing file here */
+#else
+			else if (rename(partName->c_str, fileName->c_str) != 0) /* replaces the previous object in one step */
+#endif
+			{
+				report("%sUNABLE TO WRITE %s%s%s, THE OBJECT IS LEFT IN %s%s%s!%s", LIGHT_RED, LIGHT_CYAN, fileName->c_str, LIGHT_RED, LIGHT_CYAN, partName->c_str, LIGHT_RED, NEWLINE);
+				status = -1;
+			}
 		}
-		DELETE(objectCode);
+		DELETE(fileObjectFile);
+		DELETE(partName);
+		DELETE(fileName);
 	}
 	
-	DELETE(programData.name);
-	DELETE(programData.symtab);
-	DELETE(programData.instructions);
-	DELETE(programData.warnings);
+#if TABLE_STATS
+	probeStats_print("symtab", &programData.symtab->stats, programData.symtab->num, programData.symtab->limit, 0);
+#endif
+	if (VALID(input))
+		DELETE(input);
+#if USE_ARENA
+	if (VALID(assembly))
+		ARENA_END(assembly); /* program state goes in one go instead of walking every instruction */
+	else
+#endif
+	{
+		DELETE(programData.name);
+		DELETE(programData.symtab);
+		DELETE(programData.instructions);
+		DELETE(programData.warnings);
+		DELETE(programData.names);
+	}
+	if (filter)
+		redirectDiagnostics(diagnosticsStream);
 	return status;
 }
 
+int MAIN(int argc, char* argv[])
+{
+	assembleOptions options = { false, DEFAULT_PACKING, false, 1 };
+	const char* path = NULL;
+	bool usage = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--stream") == 0)
+			options.stream = true;
+		else if (strcmp(argv[i], "--record-stats") == 0)
+			options.recordStats = true;
+		else if (strncmp(argv[i], "--pack=", 7) == 0)
+		{
+			unsigned int which = 0;
+			while (which < PACKINGS && strcmp(argv[i] + 7, packingNames[which]) != 0)
+				++which;
+			usage |= which == PACKINGS;
+			options.packing = which < PACKINGS ? (packing)which : options.packing;
+		}
+		else if (strncmp(argv[i], "--threads=", 10) == 0)
+		{
+			char* end = NULL;
+			options.threads = (unsigned int)strtoul(argv[i] + 10, &end, 10);
+			usage |= end == argv[i] + 10 || *end != 0;
+			if (options.threads == 0)
+				options.threads = processorCount();
+		}
+		else if (path == NULL)
+			path = argv[i];
+		else
+			usage = true;
+	}
+	if (usage || path == NULL)
+	{
+		printf("USAGE: %s [--mem-stats] [--stream] [--pack=greedy|instruction|full] [--record-stats] [--threads=N (0 = all processors)] <filename | - (stdin to stdout)>\n", argv[0]);
+		return -1;
+	}
+	return assemble(path, options);
+}
+
 #pragma region objects
 
 #pragma region file
 CONSTRUCTOR(file)
 {
-	file* instance = calloc(1, sizeof(file));
+	file* instance = ALLOCATE(1, sizeof(file));
 	instance->handle = NULL;
-#if DEBUG_MEM
-	printf("[file] constructed\n");
-#endif
 	return instance;
 }
 DESTRUCTOR(file)
@@ -983,9 +2659,6 @@ DESTRUCTOR(file)
 	if (!VALID(instance)) return;
 	if (VALID(instance->handle))
 		file_close(instance);
-#if DEBUG_MEM
-	printf("[file] destructed\n");
-#endif
 	return ___defaultDestructor(instance);
 }
 FUNCTION(file, open, void, const char* path, const char* mode)
@@ -998,173 +2671,753 @@ FUNCTION_NOARG(file, close, void)
 		return;
 	if (fclose(_this->handle) != 0)
 	{
-		printf("[FATAL] Unable to properly close file handle.");
+		report("[FATAL] Unable to properly close file handle.");
 		exit(-1);
 	}
 	_this->handle = NULL;
 }
-FUNCTION_NOARG(file, length, int)
+
+
+#pragma endregion
+
+#pragma region source
+CONSTRUCTOR(source)
+{
+	source* instance = ALLOCATE(1, sizeof(source));
+	instance->text = NULL;
+	instance->mapped = false;
+	return instance;
+}
+DESTRUCTOR(source)
+{
+	if (!VALID(instance)) return;
+	source_close(instance);
+	return ___defaultDestructor(instance);
+}
+static void source_growIndex(source* _this)
+{
+	_this->indexLimit <<= 1;
+	_this->index = REALLOCATE(_this->index, _this->indexLimit * sizeof(lineMap));
+}
+static void source_addLine(source* _this, const lineMap* map)
+{
+	if (_this->lines == _this->indexLimit)
+		source_growIndex(_this);
+	_this->index[_this->lines++] = *map;
+}
+/*
+* source_index for the scalar level, the memchr walk the kernels replaced: each newline, then the line's first three tabs.
+* Commas are left to the tokenizer (the flag is always set), as they were before the kernels.
+*/
+static unsigned long long source_indexLines(source* _this, const char* text, unsigned long long begin, unsigned long long end, bool final)
+{
+	const char* nul = memchr(text + begin, 0, end - begin);
+	if (VALID(nul))
+	{
+		end = nul - text;
+		final = true;
+	}
+	unsigned long long lineStart = begin;
+	while (true)
+	{
+		const char* line = text + lineStart;
+		const char* newline = lineStart < end ? memchr(line, '\n', end - lineStart) : NULL;
+		if (!VALID(newline) && !final)
+			break;
+		lineMap map = { 0 };
+		map.length = (unsigned int)(VALID(newline) ? (unsigned long long)(newline - line) : end - lineStart);
+		const char* tab = line;
+		for (unsigned int column = 0; column < 3 && VALID(tab = memchr(tab, '\t', line + map.length - tab)); ++column)
+		{
+			unsigned long long at = ++tab - line; /* offset + 1 */
+			if (at <= 0xFF)
+				map.tabs[column] = (unsigned char)at;
+			else
+				map.flags |= LINEMAP_LONG;
+		}
+		map.flags |= LINEMAP_COMMAS | (map.length > 0 && line[0] == '#' ? LINEMAP_COMMENT : 0);
+		if (lineStart < end && line[0] != '\n' && line[0] != '\t' && line[0] != ' ' && line[0] != '\r' && line[0] != '#')
+			++_this->labels;
+		source_addLine(_this, &map);
+		if (!VALID(newline))
+			return end;
+		lineStart = newline - text + 1;
+	}
+	return lineStart;
+}
+/*
+* One scan kernel pass over text[begin, end) (a line start) that replaces the index with a lineMap per complete line, and the
+* unterminated rest as a last line too when final. A NUL ends the text like the end of the input does. Returns the offset just
+* behind what was indexed, the start of an unfinished line unless final. Lines are counted in lines, and lines starting with
+* something other than whitespace or a comment (label candidates, an upper bound for the tables) in labels.
+* Each line's part of a block is handled with a few mask operations, only its first three tabs are visited one by one.
+*/
+static unsigned long long source_index(source* _this, const char* text, unsigned long long begin, unsigned long long end, bool final)
+{
+	scanKernel kernel = scanSelected();
+	_this->lines = _this->labels = 0;
+	if (!VALID(_this->index))
+	{
+		_this->indexLimit = (unsigned int)((end - begin) / 16 + 64); /* most lines are longer than 16 bytes, the rest grows */
+		_this->index = ALLOCATE_BESIDE(_this, _this->indexLimit, sizeof(lineMap));
+	}
+	if (!VALID(kernel))
+		return source_indexLines(_this, text, begin, end, final);
+
+	lineMap map = { 0 };
+	unsigned int tabs = 0;
+	unsigned long long lineStart = begin;
+	unsigned long long carry = 1; /* begin starts a line */
+	char tail[64];
+	for (unsigned long long base = begin; base < end; base += 64)
+	{
+		const char* block = text + base;
+		unsigned long long valid = ~0ULL;
+		if (end - base < 64) /* never read past the text, a mapping can end right there */
+		{
+			memset(tail, ' ', sizeof(tail));
+			memcpy(tail, block, end - base);
+			block = tail;
+			valid = lowBits((unsigned int)(end - base));
+		}
+		scanMasks masks;
+		kernel(block, &masks);
+		if ((masks.nuls & valid) != 0)
+		{
+			unsigned int nul = lowestBit(masks.nuls & valid);
+			valid = lowBits(nul);
+			end = base + nul;
+			final = true;
+		}
+		unsigned long long starts = ((masks.newlines << 1) | carry) & valid;
+		carry = masks.newlines >> 63;
+		_this->labels += bitCount(starts & ~(masks.newlines | masks.tabs | masks.spaces | masks.returns | masks.hashes));
+		unsigned long long comments = masks.hashes & starts;
+		unsigned long long newlines = masks.newlines & valid;
+
+		if (_this->lines + 64 >= _this->indexLimit)
+			source_growIndex(_this);
+		lineMap* out = _this->index + _this->lines;
+		unsigned long long rest = valid; /* bits of this block not yet given to a line */
+		while (true)
+		{
+			unsigned long long newline = newlines & (0 - newlines); /* lowest one, 0 if the line goes on into the next block */
+			unsigned long long part = rest & (newline - 1);
+			map.flags |= ((masks.commas & part) != 0 ? LINEMAP_COMMAS : 0) | ((comments & part) != 0 ? LINEMAP_COMMENT : 0);
+			for (unsigned long long found = masks.tabs & part; found != 0 && tabs < 3; found &= found - 1, ++tabs)
+			{
+				unsigned long long column = base + lowestBit(found) - lineStart + 1;
+				if (column <= 0xFF)
+					map.tabs[tabs] = (unsigned char)column;
+				else
+					map.flags |= LINEMAP_LONG;
+			}
+			if (newline == 0)
+				break;
+			unsigned long long at = base + lowestBit(newline);
+			map.length = (unsigned int)(at - lineStart);
+			*out++ = map;
+			map = (lineMap){ 0 };
+			tabs = 0;
+			lineStart = at + 1;
+			newlines ^= newline;
+			rest &= ~(newline | (newline - 1));
+		}
+		_this->lines = (unsigned int)(out - _this->index);
+	}
+	if (final) /* whatever follows the last newline is the last line, even when it is empty */
+	{
+		map.length = (unsigned int)(end - lineStart);
+		source_addLine(_this, &map);
+		lineStart = end;
+	}
+	return lineStart;
+}
+static bool source_map(source* _this, const char* path)
+{
+#if defined(_WIN32)
+	if (strcmp(path, "-") == 0)
+		return false;
+	HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (handle == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	HANDLE mapping = NULL;
+	if (GetFileSizeEx(handle, &size) && size.QuadPart > 0)
+		mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (VALID(mapping))
+	{
+		_this->text = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping); /* the view keeps the mapping alive */
+	}
+	CloseHandle(handle);
+	if (!VALID(_this->text))
+		return false;
+	_this->length = size.QuadPart;
+#else
+	int handle = strcmp(path, "-") == 0 ? dup(STDIN_FILENO) : open(path, O_RDONLY); /* stdin maps too when it's redirected from a file */
+	if (handle < 0)
+		return false;
+	struct stat info;
+	void* view = MAP_FAILED;
+	if (fstat(handle, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+		view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, handle, 0);
+	close(handle); /* the mapping keeps the file alive */
+	if (view == MAP_FAILED)
+		return false;
+#if defined(MADV_SEQUENTIAL) && defined(MADV_WILLNEED) /* only hints, strict ISO builds go without */
+	madvise(view, (size_t)info.st_size, MADV_SEQUENTIAL); /* read front to back once, let the kernel read ahead and drop behind */
+	madvise(view, (size_t)info.st_size, MADV_WILLNEED);
+#endif
+	_this->text = view;
+	_this->length = info.st_size;
+#endif
+	_this->mapped = true;
+	_this->mappedLength = _this->length;
+	return true;
+}
+static bool source_read(source* _this, const char* path) /* fallback for whatever can't be mapped (pipes, empty-looking /proc files) */
+{
+	FILE* handle = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+	if (!VALID(handle))
+		return false;
+	unsigned long long limit = 1 << 16;
+	char* buffer = ALLOCATE_BESIDE(_this, limit, sizeof(char));
+	unsigned long long used = 0;
+	unsigned long got = 0;
+	while ((got = fread(buffer + used, 1, limit - used, handle)) > 0)
+	{
+		used += got;
+		if (used == limit)
+		{
+			limit <<= 1;
+			buffer = REALLOCATE(buffer, limit);
+		}
+	}
+	if (handle != stdin)
+		fclose(handle);
+	_this->text = buffer;
+	_this->length = used;
+	return true;
+}
+FUNCTION(source, open, bool, const char* path)
+{
+	source_close(_this);
+	if (!source_map(_this, path) && !source_read(_this, path))
+		return false;
+	_this->length = source_index(_this, _this->text, 0, _this->length, true); /* the text ends at a NUL */
+	if (_this->length == 0)
+	{
+		source_close(_this);
+		return false;
+	}
+	source_rewind(_this);
+	return true;
+}
+static bool source_fill(source* _this) /* reads the next chunk behind whatever is left of the current one, false at the end of the input */
+{
+	if (_this->streamEnded)
+		return false;
+	if (_this->chunkStart > 0)
+	{
+		memmove(_this->chunk, _this->chunk + _this->chunkStart, _this->chunkUsed - _this->chunkStart);
+		_this->chunkUsed -= _this->chunkStart;
+		_this->chunkStart = 0;
+	}
+	if (_this->chunkUsed == _this->chunkLimit) /* one line longer than the chunk */
+	{
+		_this->chunkLimit <<= 1;
+		_this->chunk = REALLOCATE(_this->chunk, _this->chunkLimit);
+	}
+	unsigned long got = fread(_this->chunk + _this->chunkUsed, 1, _this->chunkLimit - _this->chunkUsed, _this->stream);
+	const char* nul = memchr(_this->chunk + _this->chunkUsed, 0, got);
+	if (VALID(nul))
+	{
+		got = nul - (_this->chunk + _this->chunkUsed);
+		_this->streamEnded = true;
+	}
+	if (got == 0)
+		_this->streamEnded = true;
+	_this->chunkUsed += got;
+	return got > 0;
+}
+FUNCTION(source, stream, bool, const char* path)
+{
+	source_close(_this);
+	_this->stream = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb"); /* stdin only streams if it can be rewound for pass 2 */
+	if (!VALID(_this->stream))
+		return false;
+#if !defined(_WIN32) && defined(POSIX_FADV_SEQUENTIAL) /* only a hint, strict ISO builds go without */
+	posix_fadvise(fileno(_this->stream), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+	_this->chunkLimit = SOURCE_CHUNK;
+	_this->chunk = ALLOCATE_BESIDE(_this, _this->chunkLimit, sizeof(char));
+	if (!source_rewind(_this))
+	{
+		source_close(_this);
+		return false;
+	}
+	return true;
+}
+FUNCTION(source, next, bool, const char** text, unsigned int* length, const lineMap** map)
+{
+	if (_this->last)
+		return false;
+	++_this->line;
+	if (!VALID(_this->stream))
+	{
+		if (_this->cursor >= _this->lines)
+			return false;
+		*map = _this->index + _this->cursor++;
+		*text = _this->text + _this->offset;
+		*length = (*map)->length;
+		_this->offset += *length + 1;
+		_this->last = _this->cursor == _this->lines;
+		return true;
+	}
+	while (_this->cursor >= _this->lines) /* the chunk's complete lines are used up, read on and index what came in */
+	{
+		bool more = source_fill(_this);
+		source_index(_this, _this->chunk, _this->chunkStart, _this->chunkUsed, !more);
+		_this->cursor = 0;
+		_this->tailIndexed = !more;
+	}
+	*map = _this->index + _this->cursor++;
+	*text = _this->chunk + _this->chunkStart;
+	*length = (*map)->length;
+	_this->chunkStart += *length + 1;
+	_this->last = _this->tailIndexed && _this->cursor == _this->lines;
+	return true;
+}
+FUNCTION_NOARG(source, rewind, bool)
+{
+	_this->cursor = 0;
+	_this->line = 0;
+	_this->offset = 0;
+	_this->last = false;
+	if (!VALID(_this->stream))
+		return VALID(_this->text);
+	if (fseek(_this->stream, 0, SEEK_SET) != 0)
+		return false;
+	_this->chunkStart = _this->chunkUsed = 0;
+	_this->streamEnded = _this->tailIndexed = false;
+	if (!source_fill(_this)) /* an empty file is as unreadable as a missing one */
+		return false;
+	source_index(_this, _this->chunk, 0, _this->chunkUsed, false);
+	return true;
+}
+FUNCTION_NOARG(source, close, void)
+{
+	if (!VALID(_this))
+		return;
+	if (VALID(_this->stream))
+	{
+		if (_this->stream != stdin)
+			fclose(_this->stream);
+		RELEASE(_this->chunk);
+		_this->stream = NULL;
+		_this->chunk = NULL;
+		_this->chunkLimit = _this->chunkStart = _this->chunkUsed = 0;
+	}
+	if (VALID(_this->index))
+		RELEASE(_this->index);
+	_this->index = NULL;
+	_this->indexLimit = _this->lines = 0;
+	if (!VALID(_this->text))
+		return;
+	if (_this->mapped)
+	{
+#if defined(_WIN32)
+		UnmapViewOfFile(_this->text);
+#else
+		munmap((void*)_this->text, (size_t)_this->mappedLength);
+#endif
+	}
+	else
+		RELEASE((void*)_this->text);
+	_this->text = NULL;
+	_this->mapped = false;
+	_this->length = _this->mappedLength = 0;
+	_this->lines = _this->labels = 0;
+}
+#pragma endregion
+
+#pragma region hashTable
+static bucket ___tombstone; /* marks a removed entry, never dereferenced for its contents */
+#define TOMBSTONE (&___tombstone)
+
+CONSTRUCTOR(hashTable)
+{
+	hashTable* instance = ALLOCATE(1, sizeof(hashTable));
+	instance->limit = 32;
+	instance->num = 0;
+	instance->tombstones = 0;
+	instance->loadFactor = HASHTABLE_LOAD_FACTOR;
+	instance->buckets = ALLOCATE(instance->limit, sizeof(bucket*));
+	return instance;
+}
+DESTRUCTOR(hashTable)
+{
+	if (!VALID(instance)) return;
+	for (unsigned int i = 0; i < instance->limit; ++i)
+		if (VALID(instance->buckets[i]) && instance->buckets[i] != TOMBSTONE)
+			DELETE(instance->buckets[i]);
+	RELEASE(instance->buckets);
+#if TABLE_STATS
+	probeStats_print("hashTable", &instance->stats, instance->num, instance->limit, instance->tombstones);
+#endif
+	return ___defaultDestructor(instance);
+}
+
+/* finds the slot holding key, or NULL-slot that ends its probe chain. firstFree gets the first reusable slot seen (tombstone or empty). */
+static unsigned int hashTable_probe(hashTable* _this, const char* key, unsigned int* firstFree)
+{
+	unsigned int hash = cstr_hash(key) % _this->limit;
+	unsigned int probes = 1;
+	bool haveFree = false;
+	while (VALID(_this->buckets[hash]))
+	{
+		bucket* entry = _this->buckets[hash];
+		if (entry == TOMBSTONE)
+		{
+			if (!haveFree && VALID(firstFree))
+			{
+				*firstFree = hash;
+				haveFree = true;
+			}
+		}
+		else if (strcmp(entry->first->c_str, key) == 0)
+			break;
+		hash = (hash + 1) % _this->limit;
+		++probes;
+	}
+	if (!haveFree && VALID(firstFree))
+		*firstFree = hash;
+	probeStats_record(&_this->stats, probes);
+	return hash;
+}
+
+FUNCTION(hashTable, rehash, void, unsigned int nextLimit)
+{
+	if (!VALID(_this) || !VALID(_this->buckets)) return;
+	bucket** nextBuckets = ALLOCATE_BESIDE(_this, nextLimit, sizeof(bucket*));
+	for (unsigned int i = 0; i < _this->limit; ++i)
+	{
+		bucket* entry = _this->buckets[i];
+		if (!VALID(entry) || entry == TOMBSTONE)
+			continue;
+		unsigned int hash = string_hash(entry->first) % nextLimit;
+		while (VALID(nextBuckets[hash]))
+			hash = (hash + 1) % nextLimit;
+		nextBuckets[hash] = entry;
+	}
+	RELEASE(_this->buckets);
+	_this->buckets = nextBuckets;
+	_this->limit = nextLimit;
+	_this->tombstones = 0;
+}
+
+FUNCTION_NOARG(hashTable, grow, void)
+{
+	if (!VALID(_this) || !VALID(_this->buckets)) return;
+	/* mostly tombstones? clean up in place rather than doubling. */
+	if ((unsigned long)_this->num * 200 < (unsigned long)_this->limit * _this->loadFactor)
+		hashTable_rehash(_this, _this->limit);
+	else
+		hashTable_rehash(_this, _this->limit << 1);
+}
+
+FUNCTION(hashTable, setLoadFactor, void, unsigned int percent)
+{
+	if (percent < 10)
+		percent = 10;
+	else if (percent > 95)
+		percent = 95; /* linear probing needs at least one empty bucket to terminate */
+	_this->loadFactor = percent;
+	if ((unsigned long)(_this->num + _this->tombstones) * 100 > (unsigned long)_this->limit * _this->loadFactor)
+		hashTable_grow(_this);
+}
+
+FUNCTION(hashTable, reserve, void, unsigned int count)
+{
+	if (!VALID(_this) || !VALID(_this->buckets)) return;
+	unsigned int nextLimit = _this->limit;
+	while ((unsigned long)count * 100 > (unsigned long)nextLimit * _this->loadFactor)
+		nextLimit <<= 1;
+	if (nextLimit != _this->limit)
+		hashTable_rehash(_this, nextLimit);
+}
+
+FUNCTION(hashTable, insert, void, const char* k, pair* v)
+{
+	unsigned int slot = 0;
+	unsigned int hash = hashTable_probe(_this, k, &slot);
+	if (VALID(_this->buckets[hash]))
+		return; /* already present */
+	bucket* entry = NEW(bucket);
+	bucket_make(entry, k, v);
+	if (_this->buckets[slot] == TOMBSTONE)
+		--_this->tombstones;
+	_this->buckets[slot] = entry;
+	++_this->num;
+	if ((unsigned long)(_this->num + _this->tombstones) * 100 > (unsigned long)_this->limit * _this->loadFactor)
+		hashTable_grow(_this);
+}
+
+FUNCTION(hashTable, remove, void, const char* val)
+{
+	unsigned int hash = hashTable_probe(_this, val, NULL);
+	if (!VALID(_this->buckets[hash]))
+		return;
+	DELETE(_this->buckets[hash]);
+	_this->buckets[hash] = TOMBSTONE;
+	--_this->num;
+	++_this->tombstones;
+}
+FUNCTION(hashTable, get, bucket*, const char* val)
 {
-	if (!VALID(_this) || !VALID(_this->handle))
-		return 0;
-	unsigned long value = 0;
-	fseek(_this->handle, 0L, SEEK_END);
-	value = ftell(_this->handle);
-	fseek(_this->handle, 0L, SEEK_SET);
-	return value;
+	return _this->buckets[hashTable_probe(_this, val, NULL)];
 }
-FUNCTION(file, readAll, void, string* str)
+FUNCTION(hashTable, has, bool, const char* val)
 {
-	if (!VALID(_this) || !VALID(_this->handle) || !VALID(str))
-		return;
-
-	unsigned long length = file_length(_this);
-	if (length == 0)
-		return;
-	char* buffer = calloc(length + 1, sizeof(char));
-	fread(buffer, 1, length, _this->handle);
-	string_append(str, buffer);
-	free(buffer);
+	return VALID(_this->buckets[hashTable_probe(_this, val, NULL)]);
 }
 
-
 #pragma endregion
 
-#pragma region hashTable
-CONSTRUCTOR(hashTable)
+#pragma region symbolTable
+CONSTRUCTOR(symbolTable)
 {
-	hashTable* instance = calloc(1, sizeof(hashTable));
-	instance->limit = 32;
+	symbolTable* instance = ALLOCATE(1, sizeof(symbolTable));
+	instance->limit = 64; //power of 2, see symbolTable_slot
 	instance->num = 0;
-	instance->buckets = calloc(instance->limit, sizeof(bucket*));
-#if DEBUG_MEM
-	printf("[table] constructed\n");
-#endif
+	instance->entries = ALLOCATE(instance->limit, sizeof(symbol));
 	return instance;
 }
-DESTRUCTOR(hashTable)
+DESTRUCTOR(symbolTable)
 {
 	if (!VALID(instance)) return;
-	for (unsigned int i = 0; i < instance->limit; ++i)
-		if (VALID(instance->buckets[i]))
-			DELETE(instance->buckets[i]);
-	free(instance->buckets);
-#if DEBUG_MEM
-	printf("[table] destructed\n");
-#endif
+	RELEASE(instance->entries);
 	return ___defaultDestructor(instance);
 }
 
-FUNCTION_NOARG(hashTable, grow, void)
+STATIC_FUNCTION(symbolTable, pack, unsigned long long, const char* who, unsigned int length)
 {
-	if (!VALID(_this) || !VALID(_this->buckets)) return;
-	_this->limit <<= 1;
-	bucket** nextBuckets = calloc(_this->limit, sizeof(bucket*));
-	for (unsigned int i = 0; i < (_this->limit >> 1); ++i)
+	if (length > 6)
+		return 0; /* too long to be a symbol */
+	unsigned long long key = 0;
+	for (unsigned int i = 0; i < length; ++i)
+		key = (key << 8) | (unsigned char)who[i];
+	return key;
+}
+
+static unsigned int symbolTable_slot(unsigned long long key, unsigned int limit)
+{
+	return (unsigned int)key_hash(key) & (limit - 1); //limit is a power of 2.
+}
+
+static void symbolTable_resize(symbolTable* _this, unsigned int nextLimit)
+{
+	unsigned int oldLimit = _this->limit;
+	symbol* oldEntries = _this->entries;
+	_this->limit = nextLimit;
+	_this->entries = ALLOCATE_BESIDE(_this, _this->limit, sizeof(symbol));
+	for (unsigned int i = 0; i < oldLimit; ++i)
 	{
-		if (!VALID(_this->buckets[i]))
+		if (oldEntries[i].key == 0)
 			continue;
-		bucket* entry = _this->buckets[i];
-		unsigned int hash = string_hash(entry->first) % _this->limit;
-		while (VALID(nextBuckets[hash]))
-			hash = (hash + 1) % _this->limit;
-		nextBuckets[hash] = entry;
+		unsigned int slot = symbolTable_slot(oldEntries[i].key, _this->limit);
+		while (_this->entries[slot].key != 0)
+			slot = (slot + 1) & (_this->limit - 1);
+		_this->entries[slot] = oldEntries[i];
 	}
-	free(_this->buckets);
-	_this->buckets = nextBuckets;
+	RELEASE(oldEntries);
 }
 
-FUNCTION(hashTable, insert, void, const char* k, pair* v)
+FUNCTION_NOARG(symbolTable, grow, void)
 {
-	bucket* entry = NEW(bucket);
-	bucket_make(entry, k, v);
-	unsigned int hash = string_hash(entry->first) % _this->limit;
-	while (VALID(_this->buckets[hash]))
-		if (string_areSame(_this->buckets[hash]->first, entry->first))
-		{
-			DELETE(entry); return;
-		}
-		else
-			hash = (hash + 1) % _this->limit;
-	_this->buckets[hash] = entry;
-	if (++_this->num == _this->limit)
-		hashTable_grow(_this);
+	if (!VALID(_this) || !VALID(_this->entries)) return;
+	symbolTable_resize(_this, _this->limit << 1);
 }
 
-FUNCTION(hashTable, remove, void, const char* val)
+FUNCTION(symbolTable, reserve, void, unsigned int count)
 {
-	string* key = NEW(string);
-	string_append(key, val);
-	unsigned int hash = string_hash(key) % _this->limit;
-	while (VALID(_this->buckets[hash]))
+	if (!VALID(_this) || !VALID(_this->entries)) return;
+	unsigned int nextLimit = _this->limit;
+	while (count * 2 > nextLimit) //same half-full rule as define.
+		nextLimit <<= 1;
+	if (nextLimit != _this->limit)
+		symbolTable_resize(_this, nextLimit);
+}
+
+FUNCTION(symbolTable, define, bool, internPool* names, unsigned int name, unsigned int line, unsigned int address)
+{
+	unsigned long long key = symbolTable_pack(internPool_text(names, name), internPool_length(names, name));
+	if (key == 0)
+		return false;
+	unsigned int slot = symbolTable_slot(key, _this->limit);
+	unsigned int probes = 1;
+	while (_this->entries[slot].key != 0)
 	{
-		if (string_areSame(_this->buckets[hash]->first, key))
+		if (_this->entries[slot].key == key)
 		{
-			DELETE(_this->buckets[hash]);
-			_this->buckets[hash] = NULL;
-			DELETE(key);
-			return;
+			probeStats_record(&_this->stats, probes);
+			return false;
 		}
-		hash = (hash + 1) % _this->limit;
+		slot = (slot + 1) & (_this->limit - 1);
+		++probes;
 	}
-	DELETE(key);
+	probeStats_record(&_this->stats, probes);
+	_this->entries[slot].key = key;
+	_this->entries[slot].name = name;
+	_this->entries[slot].line = line;
+	_this->entries[slot].address = address;
+	if (++_this->num * 2 > _this->limit) //keep at most half full so probes stay short.
+		symbolTable_grow(_this);
+	return true;
 }
-FUNCTION(hashTable, get, bucket*, const char* val)
+
+FUNCTION(symbolTable, find, symbol*, const char* name, unsigned int length)
 {
-	string* key = NEW(string);
-	pair* what = NEW(pair);
-	bucket* who = NEW(bucket);
+	return symbolTable_lookup(_this, symbolTable_pack(name, length));
+}
 
-	string_append(key, val);
-	unsigned int hash = string_hash(key) % _this->limit;
-	while (VALID(_this->buckets[hash]))
+FUNCTION(symbolTable, lookup, symbol*, unsigned long long key)
+{
+	if (key == 0)
+		return NULL;
+	unsigned int slot = symbolTable_slot(key, _this->limit);
+	unsigned int probes = 1;
+	while (_this->entries[slot].key != 0)
 	{
-		if (string_areSame(_this->buckets[hash]->first, key))
+		if (_this->entries[slot].key == key)
 		{
-			pair* data = _this->buckets[hash]->second;
-			who->first = key;
-			who->second = what;
-			what->first = data->first;
-			what->second = data->second;
-			return who;
+			probeStats_record(&_this->stats, probes);
+			return &_this->entries[slot];
 		}
-		hash = (hash + 1) % _this->limit;
+		slot = (slot + 1) & (_this->limit - 1);
+		++probes;
 	}
-	DELETE(key);
-	DELETE(what);
-	DELETE(who);
+	probeStats_record(&_this->stats, probes);
 	return NULL;
 }
-FUNCTION(hashTable, has, bool, const char* val)
+#pragma endregion
+
+#pragma region internPool
+CONSTRUCTOR(internPool)
 {
-	string* key = NEW(string);
-	string_append(key, val);
-	unsigned int hash = string_hash(key) % _this->limit;
-	while (VALID(_this->buckets[hash]))
+	internPool* instance = ALLOCATE(1, sizeof(internPool));
+	instance->capacity = 4096;
+	instance->arena = ALLOCATE(instance->capacity, sizeof(char));
+	instance->used = 1; /* ID 0 = "" at offset 0 */
+	instance->limit = 64;
+	instance->offsets = ALLOCATE(instance->limit, sizeof(unsigned int));
+	instance->lengths = ALLOCATE(instance->limit, sizeof(unsigned int));
+	instance->num = 1;
+	instance->indexLimit = 128; //power of 2, holds IDs (0 = empty slot, ID 0 is never indexed).
+	instance->index = ALLOCATE(instance->indexLimit, sizeof(unsigned int));
+	return instance;
+}
+DESTRUCTOR(internPool)
+{
+	if (!VALID(instance)) return;
+	RELEASE(instance->arena);
+	RELEASE(instance->offsets);
+	RELEASE(instance->lengths);
+	RELEASE(instance->index);
+	return ___defaultDestructor(instance);
+}
+
+FUNCTION_NOARG(internPool, grow, void)
+{
+	if (!VALID(_this) || !VALID(_this->index)) return;
+	RELEASE(_this->index);
+	_this->indexLimit <<= 1;
+	_this->index = ALLOCATE_BESIDE(_this, _this->indexLimit, sizeof(unsigned int));
+	for (unsigned int id = 1; id < _this->num; ++id)
 	{
-		if (string_areSame(_this->buckets[hash]->first, key))
-		{
-			DELETE(key);
-			return true;
-		}
-		hash = (hash + 1) % _this->limit;
+		unsigned int slot = text_hash(_this->arena + _this->offsets[id], _this->lengths[id]) & (_this->indexLimit - 1);
+		while (_this->index[slot] != 0)
+			slot = (slot + 1) & (_this->indexLimit - 1);
+		_this->index[slot] = id;
+	}
+}
+
+FUNCTION(internPool, reserve, void, unsigned int count)
+{
+	if (!VALID(_this) || !VALID(_this->index)) return;
+	if (count + 1 > _this->limit)
+	{
+		while (count + 1 > _this->limit)
+			_this->limit <<= 1;
+		_this->offsets = REALLOCATE(_this->offsets, _this->limit * sizeof(unsigned int));
+		_this->lengths = REALLOCATE(_this->lengths, _this->limit * sizeof(unsigned int));
+	}
+	while ((count + 1) * 2 > _this->indexLimit)
+		internPool_grow(_this); /* cheap while the pool is still (nearly) empty */
+}
+
+FUNCTION(internPool, intern, unsigned int, const char* text, unsigned int length)
+{
+	if (length == 0)
+		return 0;
+	unsigned int slot = text_hash(text, length) & (_this->indexLimit - 1);
+	while (_this->index[slot] != 0)
+	{
+		unsigned int id = _this->index[slot];
+		if (_this->lengths[id] == length && memcmp(_this->arena + _this->offsets[id], text, length) == 0)
+			return id;
+		slot = (slot + 1) & (_this->indexLimit - 1);
 	}
-	DELETE(key);
-	return false;
+
+	if (_this->used + length + 1 > _this->capacity)
+	{
+		while (_this->used + length + 1 > _this->capacity)
+			_this->capacity <<= 1;
+		_this->arena = REALLOCATE(_this->arena, _this->capacity);
+	}
+	if (_this->num == _this->limit)
+	{
+		_this->limit <<= 1;
+		_this->offsets = REALLOCATE(_this->offsets, _this->limit * sizeof(unsigned int));
+		_this->lengths = REALLOCATE(_this->lengths, _this->limit * sizeof(unsigned int));
+	}
+	unsigned int id = _this->num++;
+	memcpy(_this->arena + _this->used, text, length);
+	_this->arena[_this->used + length] = 0;
+	_this->offsets[id] = _this->used;
+	_this->lengths[id] = length;
+	_this->used += length + 1;
+	_this->index[slot] = id;
+	if (_this->num * 2 > _this->indexLimit) //keep the index at most half full.
+		internPool_grow(_this);
+	return id;
+}
+
+FUNCTION(internPool, text, const char*, unsigned int id)
+{
+	return _this->arena + _this->offsets[id];
 }
 
+FUNCTION(internPool, length, unsigned int, unsigned int id)
+{
+	return _this->lengths[id];
+}
+
+FUNCTION(internPool, slice, slice, unsigned int id)
+{
+	slice view = { _this->arena + _this->offsets[id], _this->lengths[id] };
+	return view;
+}
 #pragma endregion
 
 #pragma region vector
 CONSTRUCTOR(vector)
 {
-	vector* instance = calloc(1, sizeof(vector));
+	vector* instance = ALLOCATE(1, sizeof(vector));
 	instance->limit = 16;
 	instance->num = 0;
-	instance->data = calloc(instance->limit, sizeof(void*));
-#if DEBUG_MEM
-	printf("[vector] constructed\n");
-#endif
+	instance->data = ALLOCATE(instance->limit, sizeof(void*));
 	return instance;
 }
 DESTRUCTOR(vector)
@@ -1172,10 +3425,7 @@ DESTRUCTOR(vector)
 	if (!VALID(instance)) return;
 	for (unsigned int i = 0; i < instance->num; ++i)
 		DELETE(instance->data[i]);
-	free(instance->data);
-#if DEBUG_MEM
-	printf("[vector] destructed\n");
-#endif
+	RELEASE(instance->data);
 	return ___defaultDestructor(instance);
 }
 FUNCTION(vector, push_back, void, object* data)
@@ -1186,13 +3436,24 @@ FUNCTION(vector, push_back, void, object* data)
 	if (++_this->num == _this->limit)
 		vector_grow(_this);
 }
+FUNCTION(vector, reserve, void, unsigned int count)
+{
+	if (!VALID(_this) || !VALID(_this->data) || count < _this->limit)
+		return;
+	while (count >= _this->limit) //push_back grows as soon as the array is full, keep one spare slot.
+		_this->limit <<= 1;
+	object** nextData = ALLOCATE_BESIDE(_this, _this->limit, sizeof(void*));
+	memcpy(nextData, _this->data, sizeof(void*) * _this->num);
+	RELEASE(_this->data);
+	_this->data = nextData;
+}
 FUNCTION_NOARG(vector, grow, void)
 {
 	if (!VALID(_this) || !VALID(_this->data)) return;
 	_this->limit <<= 1;
-	object** nextData = calloc(_this->limit, sizeof(void*));
+	object** nextData = ALLOCATE_BESIDE(_this, _this->limit, sizeof(void*));
 	memcpy(nextData, _this->data, sizeof(void*) * _this->num);
-	free(_this->data);
+	RELEASE(_this->data);
 	_this->data = nextData;
 }
 #pragma endregion
@@ -1201,12 +3462,9 @@ FUNCTION_NOARG(vector, grow, void)
 
 CONSTRUCTOR(bucket)
 {
-	bucket* instance = calloc(1, sizeof(bucket));
+	bucket* instance = ALLOCATE(1, sizeof(bucket));
 	instance->first = NULL;
 	instance->second = NULL;
-#if DEBUG_MEM
-	printf("[pair] constructed\n");
-#endif
 	return instance;
 }
 DESTRUCTOR(bucket)
@@ -1216,9 +3474,6 @@ DESTRUCTOR(bucket)
 		DELETE(instance->first);
 	if (VALID(instance->second))
 		DELETE(instance->second);
-#if DEBUG_MEM
-	printf("[pair] destructed\n");
-#endif
 	return ___defaultDestructor(instance);
 }
 FUNCTION(bucket, make, void, const char* str, pair* value)
@@ -1237,20 +3492,14 @@ FUNCTION(bucket, make, void, const char* str, pair* value)
 
 CONSTRUCTOR(pair)
 {
-	pair* instance = calloc(1, sizeof(bucket));
+	pair* instance = ALLOCATE(1, sizeof(bucket));
 	instance->first = 0;
 	instance->second = 0;
-#if DEBUG_MEM
-	printf("[pair] constructed\n");
-#endif
 	return instance;
 }
 DESTRUCTOR(pair)
 {
 	if (!VALID(instance)) return;
-#if DEBUG_MEM
-	printf("[pair] destructed\n");
-#endif
 	return ___defaultDestructor(instance);
 }
 FUNCTION(pair, make, void, unsigned int one, unsigned int two)
@@ -1262,23 +3511,17 @@ FUNCTION(pair, make, void, unsigned int one, unsigned int two)
 #pragma region strings
 CONSTRUCTOR(string)
 {
-	string* instance = calloc(1, sizeof(string));
-	instance->limit = 32; //inital max
-	instance->c_str = calloc(instance->limit, sizeof(char));
+	string* instance = ALLOCATE(1, sizeof(string));
+	instance->limit = STRING_INLINE; //inital max
+	instance->c_str = instance->inline_str;
 	instance->length = 0;
-#if DEBUG_MEM
-	printf("[string] constructed\n");
-#endif
 	return instance;
 }
 DESTRUCTOR(string)
 {
 	if (!VALID(instance)) return;
-	if (VALID(instance->c_str))
-		free(instance->c_str);
-#if DEBUG_MEM
-	printf("[string] destructed\n");
-#endif
+	if (VALID(instance->c_str) && instance->c_str != instance->inline_str)
+		RELEASE(instance->c_str);
 	return ___defaultDestructor(instance);
 }
 
@@ -1286,94 +3529,87 @@ FUNCTION(string, format, void, const char* format, ...)
 {
 	va_list args;
 	va_start(args, format);
-	int length = vsnprintf(NULL, 0, format, args) + 1;
-	va_end(args);
-	va_start(args, format);
-	char* buffer = calloc(length, sizeof(char));
-	vsnprintf(buffer, length, format, args);
+	string_vformat(_this, format, args);
 	va_end(args);
-	string_append(_this, buffer);
-	free(buffer);
+}
+FUNCTION(string, vformat, void, const char* format, va_list args)
+{
+	/* first try writes into whatever room is left, only text that doesn't fit is formatted a second time */
+	unsigned int spare = _this->limit - _this->length; //includes the terminator.
+	va_list attempt;
+	va_copy(attempt, args);
+	int length = vsnprintf(_this->c_str + _this->length, spare, format, attempt);
+	va_end(attempt);
+	if (length <= 0)
+	{
+		_this->c_str[_this->length] = 0;
+		return;
+	}
+	if ((unsigned int)length >= spare)
+	{
+		string_reserve(_this, _this->length + length);
+		vsnprintf(_this->c_str + _this->length, length + 1, format, args);
+	}
+	_this->length += length;
+}
+FUNCTION(string, append_hex, void, unsigned int value, unsigned int width)
+{
+	string_reserve(_this, _this->length + (width > 8 ? width : 8));
+	_this->length += formatHex(_this->c_str + _this->length, value, width);
+	_this->c_str[_this->length] = 0;
 }
 STATIC_FUNCTION(string, make_and_format, string*, const char* format, ...)
 {
 	string* str = NEW(string);
 	va_list args;
 	va_start(args, format);
-	int length = vsnprintf(NULL, 0, format, args) + 1;
-	va_end(args);
-	va_start(args, format);
-	char* buffer = calloc(length, sizeof(char));
-	vsnprintf(buffer, length, format, args);
+	string_vformat(str, format, args);
 	va_end(args);
-	string_append(str, buffer);
-	free(buffer);
 	return str;
 }
-char* strtok_all(char* str, char const* delims)
+FUNCTION(string, reserve, void, unsigned int length)
 {
-	static char* src = NULL; char* loc = 0; char* ret = 0;
-	if (VALID(str))
-		src = str;
-	if (!VALID(src))
-		return NULL;
-	loc = strpbrk(src, delims);
-	ret = src;
-	if (VALID(loc)) {
-		loc[0] = 0; //convert delim to nullptr...
-
-		src = ++loc; //move to next spot in string.
+	if (length < _this->limit)
+		return;
+	unsigned int nextLimit = _this->limit;
+	while (length >= nextLimit)
+		nextLimit <<= 1;
+	if (_this->c_str == _this->inline_str) /* leaving the inline buffer */
+	{
+		char* heap = ALLOCATE_BESIDE(_this, nextLimit, sizeof(char));
+		memcpy(heap, _this->inline_str, _this->length + 1);
+		_this->c_str = heap;
 	}
-	else if (VALID(src))
-		src = NULL;
-	return ret;
+	else {
+		_this->c_str = REALLOCATE(_this->c_str, nextLimit);
+		memset(_this->c_str + _this->length, 0, nextLimit - _this->length);
+	}
+	_this->limit = nextLimit;
 }
-
-FUNCTION(string, split, void, vector* vect, const char* delim)
+FUNCTION_NOARG(string, clear, void)
 {
-	if (!VALID(_this) || !VALID(_this->c_str) || !VALID(vect))
-		return;
-	char* data = calloc(_this->limit, sizeof(char)); //create a copy of the string
-	strcpy(data, _this->c_str);
-	char* token = strtok_all(data, delim);
-
-	while (token != NULL) {
-		/*
-			vector takes ownership of this object. Normally I would use a copy-construct,
-			but without adjusting a bunch of macros to include copy-constructors this isnt' trivial
-			with a "generic" container. The vector will DELETE this when it's deleted.
-		*/
-		string* str = NEW(string);
-		string_append(str, token);
-		vector_push_back(vect, (object*)str);
-		token = strtok_all(NULL, delim);
-	}
-	free(data);
+	_this->length = 0;
+	_this->c_str[0] = 0;
 }
 FUNCTION(string, append, void, const char* data)
 {
-	unsigned int nextLength = _this->length + strlen(data);
-	if (!VALID(data) || nextLength == _this->length)
+	if (!VALID(data))
 		return;
-	if (nextLength >= _this->limit)
-	{
-		unsigned int nextLimit = _this->limit;
-		while (nextLength >= nextLimit)
-			nextLimit <<= 1;
-		_this->c_str = realloc(_this->c_str, nextLimit);
-		memset(_this->c_str + _this->length, 0, nextLimit - _this->limit);
-		_this->limit = nextLimit;
-	}
-	strcpy(_this->c_str + _this->length, data);
+	string_append_slice(_this, data, strlen(data));
+}
+FUNCTION(string, append_slice, void, const char* data, unsigned int length)
+{
+	if (!VALID(data) || length == 0)
+		return;
+	unsigned int nextLength = _this->length + length;
+	string_reserve(_this, nextLength);
+	memcpy(_this->c_str + _this->length, data, length);
+	_this->c_str[nextLength] = 0;
 	_this->length = nextLength;
 }
 FUNCTION(string, append_int, void, const int data)
 {
-	int len = snprintf(NULL, 0, "%i", data) + 1;
-	char* str = calloc(len, sizeof(char));
-	snprintf(str, len + 1, "%i", data);
-	string_append(_this, str);
-	free(str);
+	string_format(_this, "%i", data);
 }
 
 FUNCTION(string, setEqual, string*, string* other)
@@ -1388,46 +3624,451 @@ FUNCTION(string, areSame, bool, string* other)
 		return false;
 	return strcmp(_this->c_str, other->c_str) == 0;
 }
+/*
+* SipHash-1-3 keyed with a per-process random seed. Keys come from sources we don't control (student / customer submissions),
+* so the table layout must not be predictable: a fixed hash lets anagrams or same-sum labels pile into one probe chain.
+*/
+static unsigned long long hashSeed[2] = { 0x736f6d6570736575ULL, 0x646f72616e646f6dULL };
+
+void ___seedHash()
+{
+	unsigned long long seed[2] = { 0, 0 };
+	FILE* entropy = fopen("/dev/urandom", "rb");
+	if (!VALID(entropy) || fread(seed, sizeof(seed), 1, entropy) != 1)
+	{
+		/* no urandom (windows / sandboxed), mix whatever varies between runs */
+		seed[0] = (unsigned long long)time(NULL) ^ ((unsigned long long)clock() << 32);
+		seed[1] = (unsigned long long)(size_t)&seed ^ ((unsigned long long)(size_t)&___seedHash << 16);
+	}
+	if (VALID(entropy))
+		fclose(entropy);
+	hashSeed[0] ^= seed[0];
+	hashSeed[1] ^= seed[1];
+}
+
+#define ROTL64(X, B) (((X) << (B)) | ((X) >> (64 - (B))))
+#define SIPROUND(V0, V1, V2, V3) \
+	V0 += V1; V1 = ROTL64(V1, 13); V1 ^= V0; V0 = ROTL64(V0, 32); \
+	V2 += V3; V3 = ROTL64(V3, 16); V3 ^= V2; \
+	V0 += V3; V3 = ROTL64(V3, 21); V3 ^= V0; \
+	V2 += V1; V1 = ROTL64(V1, 17); V1 ^= V2; V2 = ROTL64(V2, 32);
+
+static unsigned long long siphash13(const unsigned char* data, unsigned long length)
+{
+	unsigned long long v0 = hashSeed[0] ^ 0x736f6d6570736575ULL, v1 = hashSeed[1] ^ 0x646f72616e646f6dULL;
+	unsigned long long v2 = hashSeed[0] ^ 0x6c7967656e657261ULL, v3 = hashSeed[1] ^ 0x7465646279746573ULL;
+	unsigned long long last = (unsigned long long)length << 56;
+	unsigned long i = 0;
+	for (; i + 8 <= length; i += 8)
+	{
+		unsigned long long m = 0;
+		for (unsigned int b = 0; b < 8; ++b)
+			m |= (unsigned long long)data[i + b] << (8 * b); /* little endian regardless of host */
+		v3 ^= m;
+		SIPROUND(v0, v1, v2, v3);
+		v0 ^= m;
+	}
+	for (unsigned int b = 0; i + b < length; ++b)
+		last |= (unsigned long long)data[i + b] << (8 * b);
+	v3 ^= last;
+	SIPROUND(v0, v1, v2, v3);
+	v0 ^= last;
+	v2 ^= 0xFF;
+	SIPROUND(v0, v1, v2, v3);
+	SIPROUND(v0, v1, v2, v3);
+	SIPROUND(v0, v1, v2, v3);
+	return v0 ^ v1 ^ v2 ^ v3;
+}
+
+unsigned int text_hash(const char* who, unsigned int length)
+{
+	if (!VALID(who))
+		return 0;
+	return (unsigned int)siphash13((const unsigned char*)who, length);
+}
+unsigned long long key_hash(unsigned long long key)
+{
+	unsigned char bytes[8];
+	for (unsigned int b = 0; b < 8; ++b)
+		bytes[b] = (unsigned char)(key >> (8 * b));
+	return siphash13(bytes, 8);
+}
+unsigned int cstr_hash(const char* who)
+{
+	if (!VALID(who))
+		return 0;
+	return text_hash(who, strlen(who));
+}
 FUNCTION_NOARG(string, hash, unsigned int)
 {
 	if (!VALID(_this) || !VALID(_this->c_str))
 		return 0;
-	unsigned int hash = 0, accumulator = 0;
-	while (_this->c_str[accumulator] != 0)
-		hash += _this->c_str[accumulator++] & ~0x20;
-	return hash;
+	return text_hash(_this->c_str, _this->length);
 }
 #pragma endregion
 
-#pragma region instruction
-CONSTRUCTOR(instruction)
+#pragma region instructionStore
+CONSTRUCTOR(instructionStore)
 {
-	instruction* instance = calloc(1, sizeof(instruction));
-	instance->comment = NEW(string);
-	instance->operand = NEW(string);
-	instance->opcode = NEW(string);
-	instance->symbol = NEW(string);
-#if DEBUG_MEM
-	printf("[instruction] constructed\n");
+	instructionStore* instance = ALLOCATE(1, sizeof(instructionStore));
+	instance->limit = 64;
+	instance->num = 0;
+	instance->lines = ALLOCATE(instance->limit, sizeof(unsigned int));
+	instance->labels = ALLOCATE(instance->limit, sizeof(unsigned int));
+	instance->opcodes = ALLOCATE(instance->limit, sizeof(unsigned int));
+	instance->operands = ALLOCATE(instance->limit, sizeof(unsigned int));
+	instance->addresses = ALLOCATE(instance->limit, sizeof(unsigned int));
+	instance->ids = ALLOCATE(instance->limit, sizeof(unsigned char));
+	instance->codes = ALLOCATE(instance->limit, sizeof(unsigned char));
+	instance->operandKinds = ALLOCATE(instance->limit, sizeof(unsigned char));
+	instance->operandValues = ALLOCATE(instance->limit, sizeof(unsigned long long));
+#if KEEP_COMMENTS
+	instance->comments = ALLOCATE(instance->limit, sizeof(unsigned int));
+	instance->commentText = NEW(string);
 #endif
 	return instance;
 }
-DESTRUCTOR(instruction)
+DESTRUCTOR(instructionStore)
 {
 	if (!VALID(instance)) return;
-	if (VALID(instance->comment))
-		DELETE(instance->comment);
-	if (VALID(instance->operand))
-		DELETE(instance->operand);
-	if (VALID(instance->opcode))
-		DELETE(instance->opcode);
-	if (VALID(instance->symbol))
-		DELETE(instance->symbol);
-#if DEBUG_MEM
-	printf("[instruction] destructed\n");
-#endif
+	RELEASE(instance->lines);
+	RELEASE(instance->labels);
+	RELEASE(instance->opcodes);
+	RELEASE(instance->operands);
+	RELEASE(instance->addresses);
+	RELEASE(instance->ids);
+	RELEASE(instance->codes);
+	RELEASE(instance->operandKinds);
+	RELEASE(instance->operandValues);
+	if (VALID(instance->comments))
+		RELEASE(instance->comments);
+	if (VALID(instance->commentText))
+		DELETE(instance->commentText);
 	return ___defaultDestructor(instance);
 }
+static void instructionStore_resize(instructionStore* _this, unsigned int nextLimit)
+{
+	_this->limit = nextLimit;
+	_this->lines = REALLOCATE(_this->lines, _this->limit * sizeof(unsigned int));
+	_this->labels = REALLOCATE(_this->labels, _this->limit * sizeof(unsigned int));
+	_this->opcodes = REALLOCATE(_this->opcodes, _this->limit * sizeof(unsigned int));
+	_this->operands = REALLOCATE(_this->operands, _this->limit * sizeof(unsigned int));
+	_this->addresses = REALLOCATE(_this->addresses, _this->limit * sizeof(unsigned int));
+	_this->ids = REALLOCATE(_this->ids, _this->limit * sizeof(unsigned char));
+	_this->codes = REALLOCATE(_this->codes, _this->limit * sizeof(unsigned char));
+	_this->operandKinds = REALLOCATE(_this->operandKinds, _this->limit * sizeof(unsigned char));
+	_this->operandValues = REALLOCATE(_this->operandValues, _this->limit * sizeof(unsigned long long));
+	if (VALID(_this->comments))
+		_this->comments = REALLOCATE(_this->comments, _this->limit * sizeof(unsigned int));
+}
+FUNCTION_NOARG(instructionStore, grow, void)
+{
+	if (!VALID(_this)) return;
+	instructionStore_resize(_this, _this->limit << 1);
+}
+FUNCTION(instructionStore, reserve, void, unsigned int count)
+{
+	if (!VALID(_this) || count <= _this->limit) return;
+	instructionStore_resize(_this, count);
+}
+FUNCTION(instructionStore, push, unsigned int, const lineTokens* tokens, internPool* names, unsigned int line, unsigned int address, unsigned int id, unsigned int code, unsigned char operand, unsigned long long value)
+{
+	if (_this->num == _this->limit)
+		instructionStore_grow(_this);
+	unsigned int index = _this->num++;
+	_this->lines[index] = line;
+	_this->labels[index] = internPool_intern(names, tokens->label.text, tokens->label.length);
+	_this->opcodes[index] = internPool_intern(names, tokens->mnemonic.text, tokens->mnemonic.length);
+	_this->operands[index] = internPool_intern(names, tokens->operand.text, tokens->operand.length);
+	_this->addresses[index] = address;
+	_this->ids[index] = (unsigned char)id;
+	_this->codes[index] = (unsigned char)code;
+	_this->operandKinds[index] = operand;
+	_this->operandValues[index] = value;
+	if (VALID(_this->comments))
+	{
+		/* comments are stored back to back, each one NUL terminated. offset + 1 so 0 can mean "no comment" */
+		_this->comments[index] = 0;
+		if (tokens->comment.length != 0)
+		{
+			_this->comments[index] = _this->commentText->length + 1;
+			string_append_slice(_this->commentText, tokens->comment.text, tokens->comment.length);
+			string_append(_this->commentText, "\n");
+			_this->commentText->c_str[_this->commentText->length - 1] = 0; /* the NUL is kept inside length on purpose */
+		}
+	}
+	return index;
+}
+FUNCTION(instructionStore, comment, const char*, unsigned int index)
+{
+	if (!VALID(_this->comments) || _this->comments[index] == 0)
+		return "";
+	return _this->commentText->c_str + _this->comments[index] - 1;
+}
 #pragma endregion
 
+
+#pragma endregion
+
+#pragma region benchmarks
+#if BENCHMARK
+/*
+*	Built with -DBENCHMARK, main runs these instead of assembling. Times are wall-clock via clock(), run on an otherwise idle machine.
+*/
+static double benchmark_seconds(clock_t since)
+{
+	return (double)(clock() - since) / CLOCKS_PER_SEC;
+}
+
+/* nth 6 character label whose letters are a permutation of one of several 6 letter sets (anagrams collide under a character sum). */
+static void benchmark_anagram(unsigned int n, char* out)
+{
+	char letters[7];
+	unsigned int set = n / 720, perm = n % 720;
+	for (unsigned int i = 0; i < 6; ++i)
+		letters[i] = (char)('A' + (set + i * 4) % 26);
+	for (unsigned int i = 6; i > 0; --i) /* factorial number system picks the permutation */
+	{
+		unsigned int pick = perm % i;
+		perm /= i;
+		out[6 - i] = letters[pick];
+		memmove(letters + pick, letters + pick + 1, i - pick - 1);
+	}
+	out[6] = 0;
+	out[0] = (char)('A' + (out[0] - 'A' + set / 26) % 26); /* keep sets distinct once the letter pattern repeats */
+}
+
+/* nth 6 character label whose characters all sum to 6 * 'M'. */
+static void benchmark_sameSum(unsigned int n, char* out)
+{
+	static char current[7] = "AAAAAA";
+	static unsigned int produced = 0;
+	if (n == 0)
+	{
+		memcpy(current, "AAAAAA", 7);
+		produced = 0;
+	}
+	while (true)
+	{
+		unsigned int sum = 0;
+		for (unsigned int i = 0; i < 6; ++i)
+			sum += current[i];
+		bool match = sum == 6 * 'M';
+		if (match)
+			memcpy(out, current, 7);
+		for (int i = 5; i >= 0; --i) /* odometer over A..Z */
+		{
+			if (current[i] != 'Z') { ++current[i]; break; }
+			current[i] = 'A';
+		}
+		if (match && produced++ == n)
+			return;
+	}
+}
+
+static void benchmark_hashing()
+{
+	typedef void (*generator)(unsigned int, char*);
+	const char* names[] = { "anagrams", "same sum" };
+	generator generators[] = { benchmark_anagram, benchmark_sameSum };
+	const unsigned int rounds = 20;
+
+	printf("%spathological labels, ns per lookup (avg probes)%s", LIGHT_CYAN, NEWLINE);
+	printf("%-10s %8s %22s %22s %22s\n", "labels", "count", "hashTable", "symbolTable", "internPool");
+	for (unsigned int g = 0; g < 2; ++g)
+	{
+		for (unsigned int count = 1000; count <= 64000; count <<= 1)
+		{
+			char* labels = calloc(count, 7);
+			for (unsigned int i = 0; i < count; ++i)
+				generators[g](i, labels + i * 7);
+
+			hashTable* table = NEW(hashTable);
+			symbolTable* symtab = NEW(symbolTable);
+			internPool* pool = NEW(internPool);
+			pair* value = NEW(pair);
+			for (unsigned int i = 0; i < count; ++i)
+			{
+				pair_make(value, i, i);
+				hashTable_insert(table, labels + i * 7, value);
+				symbolTable_define(symtab, pool, internPool_intern(pool, labels + i * 7, 6), i, i);
+			}
+			table->stats = (probeStats){ 0, 0, 0 };
+			symtab->stats = (probeStats){ 0, 0, 0 };
+
+			unsigned long found = 0;
+			clock_t start = clock();
+			for (unsigned int r = 0; r < rounds; ++r)
+				for (unsigned int i = 0; i < count; ++i)
+					found += VALID(hashTable_get(table, labels + i * 7));
+			double tableTime = benchmark_seconds(start);
+
+			start = clock();
+			for (unsigned int r = 0; r < rounds; ++r)
+				for (unsigned int i = 0; i < count; ++i)
+					found += VALID(symbolTable_find(symtab, labels + i * 7, 6));
+			double symtabTime = benchmark_seconds(start);
+
+			start = clock();
+			for (unsigned int r = 0; r < rounds; ++r)
+				for (unsigned int i = 0; i < count; ++i)
+					found += internPool_intern(pool, labels + i * 7, 6) != 0;
+			double poolTime = benchmark_seconds(start);
+
+			double lookups = (double)count * rounds;
+			printf("%-10s %8u %13.1f (%5.2f) %13.1f (%5.2f) %22.1f%s\n", names[g], count,
+				tableTime * 1e9 / lookups, (double)table->stats.probes / table->stats.lookups,
+				symtabTime * 1e9 / lookups, (double)symtab->stats.probes / symtab->stats.lookups,
+				poolTime * 1e9 / lookups, found == lookups * 3 ? "" : " MISSING ENTRIES");
+
+			DELETE(value); DELETE(pool); DELETE(symtab); DELETE(table);
+			free(labels);
+		}
+	}
+}
+
+/*
+* Line indexing of a large generated source. The baseline is what the scan replaces: the NUL, line count and newline split
+* memchr passes source_open used to make, plus the tokenizer's memchr for each line's first three tabs.
+*/
+static void benchmark_scanning()
+{
+	const unsigned long long size = 64ULL << 20;
+	char* text = malloc(size);
+	unsigned long long used = 0;
+	for (unsigned int i = 0; used + 64 < size; ++i)
+	{
+		switch (i % 4)
+		{
+		case 0: used += sprintf(text + used, "L%u\tLDA\tBUF%u,X\n", i % 100000, i % 977); break;
+		case 1: used += sprintf(text + used, "\tSTCH\tBUFFER,X\t. store it\n"); break;
+		case 2: used += sprintf(text + used, "#comment line %u\n", i); break;
+		default: used += sprintf(text + used, "C%u\tBYTE\tC'EOF%u'\n", i % 100000, i % 10); break;
+		}
+	}
+	const unsigned int rounds = 5;
+	printf("%sindexing %.1f MB of source, MB/s%s", LIGHT_CYAN, used / 1048576.0, NEWLINE);
+
+	unsigned long long checksum = 0;
+	clock_t start = clock();
+	for (unsigned int r = 0; r < rounds; ++r) /* NUL check, line count, then the newline split */
+	{
+		checksum += memchr(text, 0, used) == NULL;
+		const char* cursor = text;
+		unsigned int lines = 0;
+		while (VALID(cursor = memchr(cursor, '\n', text + used - cursor)))
+			++cursor, ++lines;
+		unsigned int* lengths = malloc((lines + 1) * sizeof(unsigned int));
+		unsigned long long offset = 0;
+		for (unsigned int line = 0; line <= lines; ++line)
+		{
+			const char* newline = memchr(text + offset, '\n', used - offset);
+			unsigned long long end = VALID(newline) ? (unsigned long long)(newline - text) : used;
+			lengths[line] = (unsigned int)(end - offset);
+			const char* tab = text + offset;
+			for (unsigned int column = 0; column < 3 && VALID(tab = memchr(tab, '\t', text + end - tab)); ++column)
+				checksum += ++tab - text;
+			offset = end + 1;
+		}
+		checksum += lengths[lines / 2];
+		free(lengths);
+	}
+	double baseline = benchmark_seconds(start);
+	printf("%-8s %10.0f%s", "memchr", used * (double)rounds / 1048576.0 / baseline, NEWLINE);
+
+	for (unsigned int level = SCAN_SCALAR; level <= scanSupported(); ++level)
+	{
+		scanUse((scanLevel)level);
+		source* input = NEW(source);
+		start = clock();
+		for (unsigned int r = 0; r < rounds; ++r)
+			checksum += source_index(input, text, 0, used, true);
+		double seconds = benchmark_seconds(start);
+		printf("%-8s %10.0f (%.2fx)%s", scanKernels[level].name, used * (double)rounds / 1048576.0 / seconds, baseline / seconds, NEWLINE);
+		DELETE(input);
+	}
+	scanUse(scanSupported());
+	free(text);
+	if (checksum == 0)
+		printf("unreachable\n");
+}
+
+/* hex encoding of BYTE-like data with each kernel, then short literals through the lexer and the SWAR parsers. */
+static void benchmark_hex()
+{
+	const unsigned int size = 16 << 20, rounds = 10;
+	unsigned char* bytes = malloc(size);
+	char* reference = malloc(2 * size);
+	char* out = malloc(2 * size);
+	for (unsigned int i = 0; i < size; ++i)
+		bytes[i] = (unsigned char)(' ' + (i * 7 + i / 97) % 95);
+	hexEncode_scalar(bytes, size, reference);
+
+	printf("%shex encoding %u MB, MB/s of input%s", LIGHT_CYAN, size >> 20, NEWLINE);
+	double scalar = 0;
+	for (unsigned int k = 0; k < sizeof(hexKernels) / sizeof(hexKernels[0]); ++k)
+	{
+		clock_t start = clock();
+		for (unsigned int r = 0; r < rounds; ++r)
+			hexKernels[k].kernel(bytes, size - r, out); /* odd lengths exercise the tails */
+		double seconds = benchmark_seconds(start);
+		scalar = k == 0 ? seconds : scalar;
+		bool same = memcmp(out, reference, 2 * (size - rounds + 1)) == 0;
+		printf("%-8s %10.0f (%.2fx)%s%s", hexKernels[k].name, size * (double)rounds / 1048576.0 / seconds, scalar / seconds, same ? "" : " MISMATCH", NEWLINE);
+	}
+	free(out); free(reference); free(bytes);
+
+	const unsigned int count = 1 << 20;
+	char* literals = malloc(count * 10);
+	for (unsigned int i = 0; i < count; ++i)
+		sprintf(literals + i * 10, i % 2 ? "%X" : "%d", (int)(i * 2654435761u % (i % 3 ? 0x8000 : 0x1000000)) * (i % 5 == 0 ? -1 : 1));
+	printf("%sparsing %u short literals, ns per literal%s", LIGHT_CYAN, count, NEWLINE);
+	printf("%-8s %10s %10s%s", "", "hex", "decimal", NEWLINE);
+	unsigned long hexSum[2] = { 0, 0 }; long decimalSum[2] = { 0, 0 };
+	double times[2][2];
+	for (unsigned int kind = 0; kind < 2; ++kind)
+	{
+		clock_t start = clock();
+		for (unsigned int r = 0; r < rounds; ++r)
+			for (unsigned int i = 1; i < count; i += 2)
+			{
+				slice text = { literals + i * 10, (unsigned int)strlen(literals + i * 10) };
+				unsigned long value = 0;
+				lexeme token;
+				if (kind == 1 && parseHex(text, &value))
+					hexSum[kind] += value;
+				else
+					hexSum[kind] += (lexToken(text, &token), token.hex);
+			}
+		times[kind][0] = benchmark_seconds(start);
+		start = clock();
+		for (unsigned int r = 0; r < rounds; ++r)
+			for (unsigned int i = 0; i < count; i += 2)
+			{
+				slice text = { literals + i * 10, (unsigned int)strlen(literals + i * 10) };
+				long value = 0;
+				lexeme token;
+				if (kind == 1 && parseDecimal(text, &value))
+					decimalSum[kind] += value;
+				else
+					decimalSum[kind] += (lexToken(text, &token), token.decimal);
+			}
+		times[kind][1] = benchmark_seconds(start);
+	}
+	double parsed = (double)rounds * count / 2;
+	printf("%-8s %10.1f %10.1f%s", "lexer", times[0][0] * 1e9 / parsed, times[0][1] * 1e9 / parsed, NEWLINE);
+	printf("%-8s %10.1f %10.1f%s%s", "swar", times[1][0] * 1e9 / parsed, times[1][1] * 1e9 / parsed,
+		hexSum[0] == hexSum[1] && decimalSum[0] == decimalSum[1] ? "" : " MISMATCH", NEWLINE);
+	free(literals);
+}
+
+int ___benchmark(int argc, char* argv[])
+{
+	(void)argc; (void)argv; /* same signature as MAIN, takes no options */
+	benchmark_hashing();
+	benchmark_scanning();
+	benchmark_hex();
+	return 0;
+}
+#endif
 #pragma endregion